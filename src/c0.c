@@ -17,6 +17,13 @@
 	#endif
 #endif
 
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
 #if defined(__cplusplus)
 	#include <atomic>
 	#define C0Atomic(T) std::atomic<T>
@@ -32,6 +39,150 @@
 	#define c0_atomic_store(ptr, x)     atomic_store((ptr), (x))
 #endif
 
+// atomic operations on plain fields, so the structures in the header stay plain C
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	static usize c0_atomic_load_usize(usize *ptr) {
+		usize value = *(usize volatile *)ptr;
+		_ReadWriteBarrier();
+		return value;
+	}
+	static void c0_atomic_store_usize(usize *ptr, usize value) {
+		_ReadWriteBarrier();
+		*(usize volatile *)ptr = value;
+	}
+	static void *c0_atomic_load_ptr(void *ptr) {
+		void *value = *(void *volatile *)ptr;
+		_ReadWriteBarrier();
+		return value;
+	}
+	static void c0_atomic_store_ptr(void *ptr, void *value) {
+		_ReadWriteBarrier();
+		*(void *volatile *)ptr = value;
+	}
+	static bool c0_atomic_cas_usize(usize *ptr, usize expected, usize desired) {
+		return (usize)_InterlockedCompareExchange64((__int64 volatile *)ptr, (__int64)desired, (__int64)expected) == expected;
+	}
+	static bool c0_atomic_try_lock(u32 *lock) {
+		return _InterlockedExchange((long volatile *)lock, 1) == 0;
+	}
+	static void c0_atomic_unlock(u32 *lock) {
+		_InterlockedExchange((long volatile *)lock, 0);
+	}
+	#define c0_cpu_relax() _mm_pause()
+#else
+	static usize c0_atomic_load_usize(usize *ptr) {
+		return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+	}
+	static void c0_atomic_store_usize(usize *ptr, usize value) {
+		__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+	}
+	static void *c0_atomic_load_ptr(void *ptr) {
+		return __atomic_load_n((void **)ptr, __ATOMIC_ACQUIRE);
+	}
+	static void c0_atomic_store_ptr(void *ptr, void *value) {
+		__atomic_store_n((void **)ptr, value, __ATOMIC_RELEASE);
+	}
+	static bool c0_atomic_cas_usize(usize *ptr, usize expected, usize desired) {
+		return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	}
+	static bool c0_atomic_try_lock(u32 *lock) {
+		return __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) == 0;
+	}
+	static void c0_atomic_unlock(u32 *lock) {
+		__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+	}
+	#if defined(__x86_64__) || defined(__i386__)
+		#define c0_cpu_relax() __builtin_ia32_pause()
+	#else
+		#define c0_cpu_relax() ((void)0)
+	#endif
+#endif
+
+static void c0_spin_lock(u32 *lock) {
+	while (!c0_atomic_try_lock(lock)) {
+		c0_cpu_relax();
+	}
+}
+
+#if defined(_WIN32)
+	typedef SRWLOCK C0Mutex;
+	#define C0_MUTEX_INIT SRWLOCK_INIT
+
+	static void c0_mutex_lock(C0Mutex *m)   { AcquireSRWLockExclusive(m); }
+	static void c0_mutex_unlock(C0Mutex *m) { ReleaseSRWLockExclusive(m); }
+
+	typedef void (*C0ThreadProc)(void *data);
+	typedef struct C0Thread {
+		HANDLE       handle;
+		C0ThreadProc proc;
+		void *       data;
+	} C0Thread;
+
+	static DWORD WINAPI c0_thread_entry(LPVOID arg) {
+		C0Thread *t = (C0Thread *)arg;
+		t->proc(t->data);
+		return 0;
+	}
+	static void c0_thread_start(C0Thread *t, C0ThreadProc proc, void *data) {
+		t->proc = proc;
+		t->data = data;
+		t->handle = CreateThread(NULL, 0, c0_thread_entry, t, 0, NULL);
+		C0_ASSERT(t->handle != NULL);
+	}
+	static void c0_thread_join(C0Thread *t) {
+		WaitForSingleObject(t->handle, INFINITE);
+		CloseHandle(t->handle);
+		t->handle = NULL;
+	}
+
+	// seconds since some fixed point in the past, only useful for measuring
+	static f64 c0_time_now(void) {
+		LARGE_INTEGER counter, frequency;
+		QueryPerformanceCounter(&counter);
+		QueryPerformanceFrequency(&frequency);
+		return (f64)counter.QuadPart / (f64)frequency.QuadPart;
+	}
+#else
+	#include <pthread.h>
+	#include <time.h>
+
+	typedef pthread_mutex_t C0Mutex;
+	#define C0_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+
+	static void c0_mutex_lock(C0Mutex *m)   { pthread_mutex_lock(m); }
+	static void c0_mutex_unlock(C0Mutex *m) { pthread_mutex_unlock(m); }
+
+	typedef void (*C0ThreadProc)(void *data);
+	typedef struct C0Thread {
+		pthread_t    handle;
+		C0ThreadProc proc;
+		void *       data;
+	} C0Thread;
+
+	static void *c0_thread_entry(void *arg) {
+		C0Thread *t = (C0Thread *)arg;
+		t->proc(t->data);
+		return NULL;
+	}
+	static void c0_thread_start(C0Thread *t, C0ThreadProc proc, void *data) {
+		t->proc = proc;
+		t->data = data;
+		int err = pthread_create(&t->handle, NULL, c0_thread_entry, t);
+		C0_ASSERT(err == 0);
+	}
+	static void c0_thread_join(C0Thread *t) {
+		pthread_join(t->handle, NULL);
+	}
+
+	// seconds since some fixed point in the past, only useful for measuring
+	static f64 c0_time_now(void) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (f64)ts.tv_sec + (f64)ts.tv_nsec*1e-9;
+	}
+#endif
+
 void c0_assert_handler(char const *prefix, char const *condition, char const *file, int line, char const *msg, ...) {
 	fprintf(stderr, "%s(%d): %s: ", file, line, prefix);
 	if (condition)
@@ -76,15 +227,61 @@ void *c0_heap_resize(void *ptr, isize size) {
 	return realloc(ptr, size);
 }
 
+static void *c0_heap_allocator_proc(void *data, void *old_ptr, usize old_size, usize new_size, usize alignment) {
+	C0_ASSERT(alignment <= 2*sizeof(isize));
+	return c0_heap_resize(old_ptr, new_size);
+}
+
+C0Allocator c0_heap_allocator(void) {
+	C0Allocator a = {0};
+	a.proc = c0_heap_allocator_proc;
+	return a;
+}
+
+void *c0_allocator_alloc(C0Allocator *a, usize size, usize alignment) {
+	return a->proc(a->data, NULL, 0, size, alignment);
+}
+void *c0_allocator_resize(C0Allocator *a, void *ptr, usize old_size, usize new_size, usize alignment) {
+	return a->proc(a->data, ptr, old_size, new_size, alignment);
+}
+void c0_allocator_free(C0Allocator *a, void *ptr, usize size) {
+	if (ptr) {
+		a->proc(a->data, ptr, size, 0, 0);
+	}
+}
+
+static C0Allocator c0_global_heap_allocator = {c0_heap_allocator_proc, NULL};
+
+static C0Allocator *c0array_allocator(C0Array *meta) {
+	return meta->allocator ? meta->allocator : &c0_global_heap_allocator;
+}
+
+bool c0array_init_internal(void **const array, C0Allocator *allocator, usize cap, usize type_size) {
+	C0_ASSERT(*array == NULL);
+	if (cap == 0) {
+		cap = 1;
+	}
+	C0Array *meta = (C0Array *)c0_allocator_alloc(allocator, type_size * cap + sizeof(C0Array), alignof(C0Array));
+	if (!meta) {
+		return false;
+	}
+	meta->len = 0;
+	meta->cap = cap;
+	meta->allocator = allocator;
+	*array = meta + 1;
+	return true;
+}
+
 bool c0array_grow_internal(void **const array, usize elements, usize type_size) {
 	usize count = 0;
 	void *data = 0;
 	if (*array) {
 		C0Array *const meta = c0array_meta(*array);
+		C0Allocator *allocator = c0array_allocator(meta);
 		count = 2 * meta->cap + elements;
-		data = c0_heap_resize(meta, type_size * count + sizeof(*meta));
+		data = c0_allocator_resize(allocator, meta, type_size * meta->cap + sizeof(*meta), type_size * count + sizeof(*meta), alignof(C0Array));
 		if (!data) {
-			c0_heap_free(meta);
+			c0_allocator_free(allocator, meta, type_size * meta->cap + sizeof(*meta));
 			return false;
 		}
 	} else {
@@ -102,7 +299,8 @@ bool c0array_grow_internal(void **const array, usize elements, usize type_size)
 }
 void c0array_delete(void *const array) {
 	if (array) {
-		c0_heap_free(c0array_meta(array));
+		C0Array *meta = c0array_meta(array);
+		c0_allocator_free(c0array_allocator(meta), meta, 0);
 	}
 }
 
@@ -136,12 +334,30 @@ static usize c0_align_formula(usize size, usize align) {
 }
 
 enum { C0_DEFAULT_MINIMUM_BLOCK_SIZE = 8ll*1024ll*1024ll };
+enum { C0_DEFAULT_RESERVE_SIZE = 4ll*1024ll*1024ll*1024ll };
+enum { C0_DEFAULT_BLOCK_POOL_CAPACITY = 64ll*1024ll*1024ll };
+enum { C0_PROC_ARENA_MINIMUM_BLOCK_SIZE = 64ll*1024ll };
+enum {
+	C0_MINIMUM_COMMIT_SIZE = 64ll*1024ll,
+	C0_MAXIMUM_COMMIT_SIZE = 64ll*1024ll*1024ll,
+};
 
 static usize DEFAULT_PAGE_SIZE = 4096;
 
-static C0MemoryBlock *c0_virtual_memory_alloc(usize size);
+static C0MemoryBlock *c0_virtual_memory_alloc(usize size, C0ArenaFlags flags);
 static void c0_virtual_memory_dealloc(C0MemoryBlock *block);
 
+static void *c0_platform_virtual_memory_reserve(usize size);
+static void  c0_platform_virtual_memory_commit(void *memory, usize size);
+static void  c0_platform_virtual_memory_decommit(void *memory, usize size);
+static void  c0_platform_virtual_memory_release(void *memory, usize size);
+static void  c0_platform_virtual_memory_advise_huge(void *memory, usize size);
+static void  c0_arena_commit(C0Arena *arena, usize used);
+
+
+static usize c0_arena_reserved_header_size(void) {
+	return c0_align_formula(sizeof(C0MemoryBlock), 16);
+}
 
 static usize arena_align_forward_offset(C0Arena *arena, usize alignment) {
 	usize alignment_offset = 0;
@@ -153,8 +369,117 @@ static usize arena_align_forward_offset(C0Arena *arena, usize alignment) {
 	return alignment_offset;
 }
 
+static C0MemoryBlock *c0_arena_push_block(C0Arena *arena, usize size) {
+	if (arena->minimum_block_size == 0) {
+		arena->minimum_block_size = C0_DEFAULT_MINIMUM_BLOCK_SIZE;
+	}
+
+	usize block_size = size;
+	if (block_size < arena->minimum_block_size) {
+		block_size = arena->minimum_block_size;
+	}
+
+	C0MemoryBlock *new_block = c0_virtual_memory_alloc(block_size, arena->flags);
+	new_block->prev = arena->curr_block;
+	c0_atomic_store_ptr(&arena->curr_block, new_block);
+	return new_block;
+}
+
+// Lock-free bump allocation, the lock is only taken to push a new block or commit more memory
+static void *c0_arena_alloc_atomic(C0Arena *arena, usize min_size, usize alignment) {
+	for (;;) {
+		C0MemoryBlock *block = (C0MemoryBlock *)c0_atomic_load_ptr(&arena->curr_block);
+		if (block != NULL) {
+			usize used = c0_atomic_load_usize(&block->used);
+			usize ptr  = (usize)(block->base + used);
+			usize mask = alignment-1;
+			usize alignment_offset = (ptr & mask) ? alignment - (ptr & mask) : 0;
+			usize new_used = used + alignment_offset + min_size;
+			if (new_used <= block->size) {
+				if (!c0_atomic_cas_usize(&block->used, used, new_used)) {
+					continue;
+				}
+				if (block == arena->reserved_block &&
+				    c0_arena_reserved_header_size() + new_used > c0_atomic_load_usize(&arena->committed)) {
+					c0_spin_lock(&arena->lock);
+					c0_arena_commit(arena, new_used);
+					c0_atomic_unlock(&arena->lock);
+				}
+				return (void *)(ptr + alignment_offset);
+			}
+		}
+
+		c0_spin_lock(&arena->lock);
+		if (c0_atomic_load_ptr(&arena->curr_block) == block) {
+			c0_arena_push_block(arena, c0_align_formula(min_size, alignment));
+		}
+		c0_atomic_unlock(&arena->lock);
+	}
+}
+
+// each thread carves small chunks out of a shared arena and bump allocates from them
+// without any atomics, `generation` tells a stale chunk apart after the arena has been freed
+typedef struct C0ArenaThreadCache C0ArenaThreadCache;
+struct C0ArenaThreadCache {
+	C0Arena *arena;
+	usize    generation;
+	u8 *     ptr;
+	u8 *     end;
+};
+enum {
+	C0_ARENA_THREAD_CACHE_COUNT = 4,
+	C0_ARENA_THREAD_CHUNK_SIZE  = 64*1024,
+	C0_ARENA_THREAD_CACHE_LIMIT = 1024, // larger allocations go straight to the arena
+};
+static C0_THREAD_LOCAL C0ArenaThreadCache c0_arena_thread_caches[C0_ARENA_THREAD_CACHE_COUNT];
+static C0Atomic(usize) c0_global_arena_generation;
+
+static void *c0_arena_alloc_thread_safe(C0Arena *arena, usize min_size, usize alignment) {
+	if (min_size > C0_ARENA_THREAD_CACHE_LIMIT) {
+		return c0_arena_alloc_atomic(arena, min_size, alignment);
+	}
+
+	usize generation = c0_atomic_load_usize(&arena->generation);
+	if (generation == 0) {
+		usize fresh = 1 + c0_atomic_fetch_add(&c0_global_arena_generation, 1);
+		if (c0_atomic_cas_usize(&arena->generation, 0, fresh)) {
+			generation = fresh;
+		} else {
+			generation = c0_atomic_load_usize(&arena->generation);
+		}
+	}
+
+	C0ArenaThreadCache *cache = &c0_arena_thread_caches[((usize)arena >> 4) % C0_ARENA_THREAD_CACHE_COUNT];
+	for (usize i = 0; i < C0_ARENA_THREAD_CACHE_COUNT; i++) {
+		if (c0_arena_thread_caches[i].arena == arena) {
+			cache = &c0_arena_thread_caches[i];
+			break;
+		}
+	}
+	if (cache->arena != arena || cache->generation != generation) {
+		cache->arena      = arena;
+		cache->generation = generation;
+		cache->ptr        = NULL;
+		cache->end        = NULL;
+	}
+
+	for (;;) {
+		usize ptr  = (usize)cache->ptr;
+		usize mask = alignment-1;
+		usize alignment_offset = (ptr & mask) ? alignment - (ptr & mask) : 0;
+		if (cache->ptr != NULL && ptr + alignment_offset + min_size <= (usize)cache->end) {
+			cache->ptr = (u8 *)(ptr + alignment_offset + min_size);
+			return (void *)(ptr + alignment_offset);
+		}
+		cache->ptr = (u8 *)c0_arena_alloc_atomic(arena, C0_ARENA_THREAD_CHUNK_SIZE, 16);
+		cache->end = cache->ptr + C0_ARENA_THREAD_CHUNK_SIZE;
+	}
+}
+
 void *c0_arena_alloc(C0Arena *arena, usize min_size, usize alignment) {
-	// mutex_lock(&arena->mutex);
+	if (arena->flags & C0ArenaFlag_thread_safe) {
+		return c0_arena_alloc_thread_safe(arena, min_size, alignment);
+	}
 
 	usize size = 0;
 	if (arena->curr_block != NULL) {
@@ -163,18 +488,7 @@ void *c0_arena_alloc(C0Arena *arena, usize min_size, usize alignment) {
 
 	if (arena->curr_block == NULL || (arena->curr_block->used + size) > arena->curr_block->size) {
 		size = c0_align_formula(min_size, alignment);
-		if (arena->minimum_block_size < C0_DEFAULT_MINIMUM_BLOCK_SIZE) {
-			arena->minimum_block_size = C0_DEFAULT_MINIMUM_BLOCK_SIZE;
-		}
-
-		usize block_size = size;
-		if (block_size < arena->minimum_block_size) {
-			block_size = arena->minimum_block_size;
-		}
-
-		C0MemoryBlock *new_block = c0_virtual_memory_alloc(block_size);
-		new_block->prev = arena->curr_block;
-		arena->curr_block = new_block;
+		c0_arena_push_block(arena, size);
 	}
 
 	C0MemoryBlock *curr_block = arena->curr_block;
@@ -185,31 +499,226 @@ void *c0_arena_alloc(C0Arena *arena, usize min_size, usize alignment) {
 
 	curr_block->used += size;
 	C0_ASSERT(curr_block->used <= curr_block->size);
-
-	// mutex_unlock(&arena->mutex);
+	if (curr_block == arena->reserved_block) {
+		c0_arena_commit(arena, curr_block->used);
+	}
 
 	// NOTE(bill): memory will be zeroed by default due to virtual memory
 	return ptr;
 }
 
+bool c0_arena_try_grow(C0Arena *arena, void *ptr, usize old_size, usize new_size) {
+	C0_ASSERT((arena->flags & C0ArenaFlag_thread_safe) == 0);
+	C0MemoryBlock *block = arena->curr_block;
+	if (block == NULL || (u8 *)ptr + old_size != block->base + block->used) {
+		return false;
+	}
+	if (new_size <= old_size) {
+		return true;
+	}
+	usize extra = new_size - old_size;
+	if (block->used + extra > block->size) {
+		return false;
+	}
+	block->used += extra;
+	if (block == arena->reserved_block) {
+		c0_arena_commit(arena, block->used);
+	}
+	return true;
+}
+
+
+void c0_arena_init_reserve(C0Arena *arena, usize reserve_size) {
+	C0_ASSERT(arena->reserved_block == NULL);
+	if (reserve_size == 0) {
+		reserve_size = C0_DEFAULT_RESERVE_SIZE;
+	}
+	reserve_size = c0_align_formula(reserve_size, DEFAULT_PAGE_SIZE);
+
+	u8 *memory = (u8 *)c0_platform_virtual_memory_reserve(reserve_size);
+	usize header_size = c0_arena_reserved_header_size();
+	if (arena->flags & C0ArenaFlag_huge_pages) {
+		c0_platform_virtual_memory_advise_huge(memory, reserve_size);
+	}
+	c0_platform_virtual_memory_commit(memory, DEFAULT_PAGE_SIZE);
+
+	C0MemoryBlock *block = (C0MemoryBlock *)memory;
+	block->base = memory + header_size;
+	block->size = reserve_size - header_size;
+	block->used = 0;
+	block->prev = arena->curr_block;
+
+	arena->curr_block     = block;
+	arena->reserved_block = block;
+	arena->committed      = DEFAULT_PAGE_SIZE;
+}
+
+// Makes sure the first `used` bytes of the reserved block are committed
+// commits grow geometrically (within limits) to keep the number of syscalls low
+static void c0_arena_commit(C0Arena *arena, usize used) {
+	C0MemoryBlock *block = arena->reserved_block;
+	usize needed = c0_arena_reserved_header_size() + used;
+	if (needed <= arena->committed) {
+		return;
+	}
+	usize reserve_size = c0_arena_reserved_header_size() + block->size;
+
+	usize step = arena->committed;
+	if (step < C0_MINIMUM_COMMIT_SIZE) {
+		step = C0_MINIMUM_COMMIT_SIZE;
+	} else if (step > C0_MAXIMUM_COMMIT_SIZE) {
+		step = C0_MAXIMUM_COMMIT_SIZE;
+	}
+	usize new_committed = arena->committed + step;
+	if (new_committed < needed) {
+		new_committed = needed;
+	}
+	new_committed = c0_align_formula(new_committed, DEFAULT_PAGE_SIZE);
+	if (new_committed > reserve_size) {
+		new_committed = reserve_size;
+	}
+
+	c0_platform_virtual_memory_commit((u8 *)block + arena->committed, new_committed - arena->committed);
+	c0_atomic_store_usize(&arena->committed, new_committed);
+}
+
 void arena_free_all(C0Arena *arena) {
+	arena->generation = 0;
+
+	C0MemoryBlock *reserved = arena->reserved_block;
 	while (arena->curr_block != NULL) {
 		C0MemoryBlock *free_block = arena->curr_block;
 		arena->curr_block = free_block->prev;
+		if (free_block != reserved) {
+			c0_virtual_memory_dealloc(free_block);
+		}
+	}
+
+	if (reserved != NULL) {
+		usize header_size = c0_arena_reserved_header_size();
+		if (arena->committed > DEFAULT_PAGE_SIZE) {
+			c0_platform_virtual_memory_decommit((u8 *)reserved + DEFAULT_PAGE_SIZE, arena->committed - DEFAULT_PAGE_SIZE);
+			arena->committed = DEFAULT_PAGE_SIZE;
+		}
+		usize dirty = reserved->used;
+		if (dirty > DEFAULT_PAGE_SIZE - header_size) {
+			dirty = DEFAULT_PAGE_SIZE - header_size;
+		}
+		memset(reserved->base, 0, dirty);
+		reserved->used = 0;
+		reserved->prev = NULL;
+		arena->curr_block = reserved;
+	}
+}
+
+static void *c0_arena_allocator_proc(void *data, void *old_ptr, usize old_size, usize new_size, usize alignment) {
+	C0Arena *arena = (C0Arena *)data;
+	if (new_size == 0) {
+		return NULL;
+	}
+	if (old_ptr != NULL && (arena->flags & C0ArenaFlag_thread_safe) == 0 &&
+	    c0_arena_try_grow(arena, old_ptr, old_size, new_size)) {
+		return old_ptr;
+	}
+	void *ptr = c0_arena_alloc(arena, new_size, alignment);
+	if (old_ptr != NULL) {
+		memmove(ptr, old_ptr, old_size < new_size ? old_size : new_size);
+	}
+	return ptr;
+}
+
+C0Allocator c0_arena_allocator(C0Arena *arena) {
+	C0Allocator a = {0};
+	a.proc = c0_arena_allocator_proc;
+	a.data = arena;
+	return a;
+}
+
+void c0_arena_destroy(C0Arena *arena) {
+	arena_free_all(arena);
+	C0MemoryBlock *reserved = arena->reserved_block;
+	if (reserved != NULL) {
+		usize reserve_size = c0_arena_reserved_header_size() + reserved->size;
+		c0_platform_virtual_memory_decommit(reserved, arena->committed);
+		c0_platform_virtual_memory_release(reserved, reserve_size);
+		arena->reserved_block = NULL;
+		arena->curr_block     = NULL;
+		arena->committed      = 0;
+	}
+}
+
+C0ArenaTemp c0_arena_mark(C0Arena *arena) {
+	C0_ASSERT((arena->flags & C0ArenaFlag_thread_safe) == 0);
+	C0ArenaTemp temp = {0};
+	temp.arena = arena;
+	temp.block = arena->curr_block;
+	temp.used  = arena->curr_block ? arena->curr_block->used : 0;
+	return temp;
+}
+
+void c0_arena_rewind(C0ArenaTemp temp) {
+	C0Arena *arena = temp.arena;
+	while (arena->curr_block != temp.block) {
+		C0MemoryBlock *free_block = arena->curr_block;
+		C0_ASSERT(free_block != NULL && "invalid arena rewind");
+		if (free_block == arena->reserved_block) {
+			C0_ASSERT(free_block->prev == NULL && "invalid arena rewind");
+			break;
+		}
+		arena->curr_block = free_block->prev;
 		c0_virtual_memory_dealloc(free_block);
 	}
+
+	C0MemoryBlock *block = arena->curr_block;
+	if (block != NULL) {
+		usize used = block == temp.block ? temp.used : 0;
+		C0_ASSERT(used <= block->used);
+		memset(block->base + used, 0, block->used - used);
+		block->used = used;
+	}
+}
+
+static C0_THREAD_LOCAL C0Arena c0_scratch_arenas[2];
+
+C0ArenaTemp c0_scratch_begin(C0Arena *conflict) {
+	C0Arena *arena = &c0_scratch_arenas[0];
+	if (arena == conflict) {
+		arena = &c0_scratch_arenas[1];
+	}
+	if (arena->reserved_block == NULL) {
+		c0_arena_init_reserve(arena, 0);
+	}
+	return c0_arena_mark(arena);
+}
+
+void c0_scratch_end(C0ArenaTemp temp) {
+	c0_arena_rewind(temp);
+}
+
+void c0_scratch_destroy(void) {
+	for (usize i = 0; i < 2; i++) {
+		c0_arena_destroy(&c0_scratch_arenas[i]);
+	}
 }
 
 
 struct C0PlatformMemoryBlock {
 	C0MemoryBlock block; // IMPORTANT NOTE: must be at the start
 	usize total_size;
+	C0ArenaFlags flags;
 	C0PlatformMemoryBlock *prev, *next;
 };
 
 
 static C0Atomic(usize) c0_global_platform_memory_total_usage;
 static C0PlatformMemoryBlock c0_global_platform_memory_block_sentinel;
+static C0Mutex c0_global_memory_block_mutex = C0_MUTEX_INIT;
+
+// pooled blocks are not in the global block list, they are linked through `next`
+static C0PlatformMemoryBlock *c0_global_block_pool;
+static usize c0_global_block_pool_size;
+static usize c0_global_block_pool_capacity = C0_DEFAULT_BLOCK_POOL_CAPACITY;
+static C0Mutex c0_global_block_pool_mutex = C0_MUTEX_INIT;
 
 static C0PlatformMemoryBlock *c0_platform_virtual_memory_alloc(isize total_size);
 static void c0_platform_virtual_memory_free(C0PlatformMemoryBlock *block);
@@ -248,8 +757,33 @@ static void c0_platform_virtual_memory_protect(void *memory, isize size);
 		BOOL is_protected = VirtualProtect(memory, size, PAGE_NOACCESS, &old_protect);
 		C0_ASSERT(is_protected);
 	}
+
+	static void *c0_platform_virtual_memory_reserve(usize size) {
+		void *memory = VirtualAlloc(0, size, MEM_RESERVE, PAGE_READWRITE);
+		if (memory == NULL) {
+			fprintf(stderr, "Out of Virtual memory, oh no...\n");
+			fprintf(stderr, "Requested reserve: %llu bytes\n", (unsigned long long)size);
+			C0_ASSERT(memory != NULL && "Out of Virtual Memory, oh no...");
+		}
+		return memory;
+	}
+	static void c0_platform_virtual_memory_commit(void *memory, usize size) {
+		void *res = VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE);
+		C0_ASSERT(res != NULL && "Out of Virtual Memory, oh no...");
+		c0_global_platform_memory_total_usage += size; // @atomic
+	}
+	static void c0_platform_virtual_memory_decommit(void *memory, usize size) {
+		c0_global_platform_memory_total_usage -= size; // @atomic
+		VirtualFree(memory, size, MEM_DECOMMIT);
+	}
+	static void c0_platform_virtual_memory_release(void *memory, usize size) {
+		VirtualFree(memory, 0, MEM_RELEASE);
+	}
+	static void c0_platform_virtual_memory_advise_huge(void *memory, usize size) {
+		// large pages on Windows need SeLockMemoryPrivilege and cannot be committed lazily, so this is a hint we ignore
+	}
 #else
-	static void c0_platform_virtual_memory_init(void) {
+	void c0_platform_virtual_memory_init(void) {
 		c0_global_platform_memory_block_sentinel.prev = &c0_global_platform_memory_block_sentinel;
 		c0_global_platform_memory_block_sentinel.next = &c0_global_platform_memory_block_sentinel;
 
@@ -261,11 +795,11 @@ static void c0_platform_virtual_memory_protect(void *memory, isize size);
 
 	static C0PlatformMemoryBlock *c0_platform_virtual_memory_alloc(isize total_size) {
 		C0PlatformMemoryBlock *pmblock = (C0PlatformMemoryBlock *)mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-		if (pmblock == NULL) {
+		if (pmblock == MAP_FAILED) {
 			fprintf(stderr, "Out of Virtual memory, oh no...\n");
 			fprintf(stderr, "Requested: %lld bytes\n", (long long)total_size);
 			fprintf(stderr, "Total Usage: %lld bytes\n", (long long)c0_global_platform_memory_total_usage);
-			C0_ASSERT(pmblock != NULL, "Out of Virtual Memory, oh no...");
+			C0_ASSERT(pmblock != MAP_FAILED && "Out of Virtual Memory, oh no...");
 		}
 		c0_global_platform_memory_total_usage += total_size;
 		return pmblock;
@@ -279,9 +813,144 @@ static void c0_platform_virtual_memory_protect(void *memory, isize size);
 		int err = mprotect(memory, size, PROT_NONE);
 		C0_ASSERT(err == 0);
 	}
+
+	static void *c0_platform_virtual_memory_reserve(usize size) {
+		void *memory = mmap(NULL, size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+		if (memory == MAP_FAILED) {
+			fprintf(stderr, "Out of Virtual memory, oh no...\n");
+			fprintf(stderr, "Requested reserve: %lld bytes\n", (long long)size);
+			C0_ASSERT(memory != MAP_FAILED && "Out of Virtual Memory, oh no...");
+		}
+		return memory;
+	}
+	static void c0_platform_virtual_memory_commit(void *memory, usize size) {
+		int err = mprotect(memory, size, PROT_READ | PROT_WRITE);
+		C0_ASSERT(err == 0 && "Out of Virtual Memory, oh no...");
+		c0_global_platform_memory_total_usage += size;
+	}
+	static void c0_platform_virtual_memory_decommit(void *memory, usize size) {
+		c0_global_platform_memory_total_usage -= size;
+		madvise(memory, size, MADV_DONTNEED);
+		mprotect(memory, size, PROT_NONE);
+	}
+	static void c0_platform_virtual_memory_release(void *memory, usize size) {
+		munmap(memory, size);
+	}
+	static void c0_platform_virtual_memory_advise_huge(void *memory, usize size) {
+	#if defined(MADV_HUGEPAGE)
+		madvise(memory, size, MADV_HUGEPAGE);
+	#endif
+	}
+#endif
+
+#if defined(_WIN32)
+	static void c0_platform_write_fd(int fd, void const *data, usize len) {
+		u8 const *ptr = (u8 const *)data;
+		while (len > 0) {
+			unsigned n = len > 0x40000000u ? 0x40000000u : (unsigned)len;
+			int written = _write(fd, ptr, n);
+			C0_ASSERT(written > 0);
+			ptr += written;
+			len -= written;
+		}
+	}
+#else
+	static void c0_platform_write_fd(int fd, void const *data, usize len) {
+		u8 const *ptr = (u8 const *)data;
+		while (len > 0) {
+			isize written = write(fd, ptr, len);
+			C0_ASSERT(written > 0);
+			ptr += written;
+			len -= written;
+		}
+	}
 #endif
 
-static C0MemoryBlock *c0_virtual_memory_alloc(usize size) {
+static void c0_virtual_memory_link(C0PlatformMemoryBlock *pmblock) {
+	C0PlatformMemoryBlock *sentinel = &c0_global_platform_memory_block_sentinel;
+	c0_mutex_lock(&c0_global_memory_block_mutex);
+	pmblock->next = sentinel;
+	pmblock->prev = sentinel->prev;
+	pmblock->prev->next = pmblock;
+	pmblock->next->prev = pmblock;
+	c0_mutex_unlock(&c0_global_memory_block_mutex);
+}
+
+static void c0_virtual_memory_unlink(C0PlatformMemoryBlock *pmblock) {
+	c0_mutex_lock(&c0_global_memory_block_mutex);
+	pmblock->prev->next = pmblock->next;
+	pmblock->next->prev = pmblock->prev;
+	c0_mutex_unlock(&c0_global_memory_block_mutex);
+	pmblock->prev = NULL;
+	pmblock->next = NULL;
+}
+
+static C0PlatformMemoryBlock *c0_block_pool_take(usize size, C0ArenaFlags flags) {
+	C0PlatformMemoryBlock *pmblock = NULL;
+	c0_mutex_lock(&c0_global_block_pool_mutex);
+	for (C0PlatformMemoryBlock **link = &c0_global_block_pool; *link != NULL; link = &(*link)->next) {
+		if ((*link)->block.size >= size && (*link)->flags == flags) {
+			pmblock = *link;
+			*link = pmblock->next;
+			c0_global_block_pool_size -= pmblock->total_size;
+			break;
+		}
+	}
+	c0_mutex_unlock(&c0_global_block_pool_mutex);
+
+	if (pmblock != NULL) {
+		memset(pmblock->block.base, 0, pmblock->block.used);
+		pmblock->block.used = 0;
+		pmblock->next = NULL;
+	}
+	return pmblock;
+}
+
+static bool c0_block_pool_give(C0PlatformMemoryBlock *pmblock) {
+	bool pooled = false;
+	c0_mutex_lock(&c0_global_block_pool_mutex);
+	if (c0_global_block_pool_size + pmblock->total_size <= c0_global_block_pool_capacity) {
+		pmblock->next = c0_global_block_pool;
+		c0_global_block_pool = pmblock;
+		c0_global_block_pool_size += pmblock->total_size;
+		pooled = true;
+	}
+	c0_mutex_unlock(&c0_global_block_pool_mutex);
+	return pooled;
+}
+
+void c0_block_pool_trim(usize max_bytes) {
+	for (;;) {
+		C0PlatformMemoryBlock *pmblock = NULL;
+		c0_mutex_lock(&c0_global_block_pool_mutex);
+		if (c0_global_block_pool_size > max_bytes) {
+			pmblock = c0_global_block_pool;
+			c0_global_block_pool = pmblock->next;
+			c0_global_block_pool_size -= pmblock->total_size;
+		}
+		c0_mutex_unlock(&c0_global_block_pool_mutex);
+
+		if (pmblock == NULL) {
+			break;
+		}
+		c0_platform_virtual_memory_free(pmblock);
+	}
+}
+
+void c0_block_pool_set_capacity(usize max_bytes) {
+	c0_mutex_lock(&c0_global_block_pool_mutex);
+	c0_global_block_pool_capacity = max_bytes;
+	c0_mutex_unlock(&c0_global_block_pool_mutex);
+	c0_block_pool_trim(max_bytes);
+}
+
+static C0MemoryBlock *c0_virtual_memory_alloc(usize size, C0ArenaFlags flags) {
+	C0PlatformMemoryBlock *recycled = c0_block_pool_take(size, flags);
+	if (recycled != NULL) {
+		c0_virtual_memory_link(recycled);
+		return &recycled->block;
+	}
+
 	usize const page_size = DEFAULT_PAGE_SIZE;
 
 	usize total_size     = size + sizeof(C0PlatformMemoryBlock);
@@ -289,7 +958,7 @@ static C0MemoryBlock *c0_virtual_memory_alloc(usize size) {
 	usize protect_offset = 0;
 
 	bool do_protection = false;
-	{ // overflow protection
+	if ((flags & C0ArenaFlag_no_guard_pages) == 0) { // overflow protection
 		usize rounded_size = c0_align_formula(size, page_size);
 		total_size     = rounded_size + 2*page_size;
 		base_offset    = page_size + rounded_size - size;
@@ -308,17 +977,15 @@ static C0MemoryBlock *c0_virtual_memory_alloc(usize size) {
 	if (do_protection) {
 		c0_platform_virtual_memory_protect((u8 *)pmblock + protect_offset, page_size);
 	}
+	if (flags & C0ArenaFlag_huge_pages) {
+		c0_platform_virtual_memory_advise_huge(pmblock, total_size);
+	}
 
 	pmblock->block.size = size;
 	pmblock->total_size = total_size;
+	pmblock->flags      = flags;
 
-	C0PlatformMemoryBlock *sentinel = &c0_global_platform_memory_block_sentinel;
-	// mutex_lock(&global_memory_block_mutex);
-	pmblock->next = sentinel;
-	pmblock->prev = sentinel->prev;
-	pmblock->prev->next = pmblock;
-	pmblock->next->prev = pmblock;
-	// mutex_unlock(&global_memory_block_mutex);
+	c0_virtual_memory_link(pmblock);
 
 	return &pmblock->block;
 }
@@ -326,12 +993,11 @@ static C0MemoryBlock *c0_virtual_memory_alloc(usize size) {
 static void c0_virtual_memory_dealloc(C0MemoryBlock *block_to_free) {
 	C0PlatformMemoryBlock *block = (C0PlatformMemoryBlock *)block_to_free;
 	if (block != NULL) {
-		// mutex_lock(&global_memory_block_mutex);
-		block->prev->next = block->next;
-		block->next->prev = block->prev;
-		// mutex_unlock(&global_memory_block_mutex);
-
-		c0_platform_virtual_memory_free(block);
+		c0_virtual_memory_unlink(block);
+		block->block.prev = NULL;
+		if (!c0_block_pool_give(block)) {
+			c0_platform_virtual_memory_free(block);
+		}
 	}
 }
 
@@ -383,8 +1049,65 @@ void c0_gen_init(C0Gen *gen) {
 	}
 }
 
+static C0InternEntry *c0_intern_entry(C0Gen *gen, C0String str);
+
+static void c0_proc_release(C0Proc *p) {
+	c0array_free(p->parameters);
+	c0array_free(p->nested_blocks);
+	c0array_free(p->labels);
+	if (p->arena == &p->own_arena) {
+		// `p` lives in this arena, so copy it out before freeing
+		C0Arena own_arena = p->own_arena;
+		c0_arena_destroy(&own_arena);
+	}
+}
+
+void c0_proc_destroy(C0Proc *p) {
+	C0Gen *gen = p->gen;
+	if (p->name.len != 0) {
+		C0InternEntry *e = c0_intern_entry(gen, p->name);
+		if (e->proc == p) {
+			e->proc = NULL;
+		}
+	}
+	for (isize i = 0; i < c0array_len(gen->procs); i++) {
+		if (gen->procs[i] == p) {
+			c0array_ordered_remove(gen->procs, i);
+			break;
+		}
+	}
+	c0_proc_release(p);
+}
+
 void c0_gen_destroy(C0Gen *gen) {
-	arena_free_all(&gen->arena);
+	for (isize i = 0; i < c0array_len(gen->procs); i++) {
+		c0_proc_release(gen->procs[i]);
+	}
+	c0array_free(gen->procs);
+
+	// an unnamed signature may share `types` with the named one it was made from, so it goes last
+	for (isize i = 0; i < c0array_len(gen->types); i++) {
+		C0AggType *t = gen->types[i];
+		if (t->kind == C0AggType_record) {
+			c0array_free(t->record.names);
+			c0array_free(t->record.types);
+		} else if (t->kind == C0AggType_proc && t->proc.unnamed != t) {
+			c0array_free(t->proc.names);
+			if (t->proc.types != t->proc.unnamed->proc.types) {
+				c0array_free(t->proc.types);
+			}
+		}
+	}
+	for (isize i = 0; i < c0array_len(gen->types); i++) {
+		C0AggType *t = gen->types[i];
+		if (t->kind == C0AggType_proc && t->proc.unnamed == t) {
+			c0array_free(t->proc.types);
+		}
+	}
+	c0array_free(gen->types);
+	c0_heap_free(gen->type_table);
+	c0_heap_free(gen->intern_entries);
+	c0_arena_destroy(&gen->arena);
 }
 
 bool c0_basic_type_is_integer(C0BasicType type) {
@@ -461,36 +1184,17 @@ C0AggType *c0_agg_type_basic(C0Gen *gen, C0BasicType type) {
 	return gen->basic_agg[type];
 }
 
-C0AggType *c0_agg_type_array(C0Gen *gen, C0AggType *elem, i64 len) {
-	C0_ASSERT(len >= 0);
-	C0AggType *t = c0_arena_new(&gen->arena, C0AggType);
-	t->kind = C0AggType_array;
-	t->array.elem = elem;
-	t->array.len = len;
-	// TODO(bill): size of the array
-	t->size  = len * elem->size;
-	t->align = elem->align;
-	return t;
-}
-
-C0AggType *c0_agg_type_proc(C0Gen *gen, C0AggType *ret, C0Array(C0String) names, C0Array(C0AggType *) types, C0ProcFlags flags) {
-	C0AggType *t = c0_arena_new(&gen->arena, C0AggType);
-	t->kind = C0AggType_proc;
-	t->size = gen->ptr_size;
-	t->align = gen->ptr_size;
-
-	if (ret == NULL) {
-		ret = c0_agg_type_basic(gen, C0Basic_void);
+static bool c0_strings_equal(C0String a, C0String b) {
+	if (a.len != b.len) {
+		return false;
 	}
-	t->proc.ret = ret;
-	t->proc.names = names;
-	t->proc.types = types;
-	t->proc.flags = flags;
-	return t;
+	if (a.text == b.text) {
+		return true;
+	}
+	return memcmp(a.text, b.text, a.len) == 0;
 }
-static bool c0_types_equal(C0AggType *a, C0AggType *b);
 
-static bool c0_types_array_equal(C0Array(C0AggType *) a, C0Array(C0AggType *) b) {
+static bool c0_string_array_equal(C0Array(C0String) a, C0Array(C0String) b) {
 	if (a == b) {
 		return true;
 	}
@@ -499,24 +1203,15 @@ static bool c0_types_array_equal(C0Array(C0AggType *) a, C0Array(C0AggType *) b)
 	}
 	usize n = c0array_len(a);
 	for (usize i = 0; i < n; i++) {
-		if (!c0_types_equal(a[i], b[i])) {
+		if (!c0_strings_equal(a[i], b[i])) {
 			return false;
 		}
 	}
 	return true;
 }
 
-static bool c0_strings_equal(C0String a, C0String b) {
-	if (a.len != b.len) {
-		return false;
-	}
-	if (a.text == b.text) {
-		return true;
-	}
-	return memcmp(a.text, b.text, a.len) == 0;
-}
-
-static bool c0_string_array_equal(C0Array(C0String) a, C0Array(C0String) b) {
+// only valid on interned types, where the children are already canonical
+static bool c0_types_array_identical(C0Array(C0AggType *) a, C0Array(C0AggType *) b) {
 	if (a == b) {
 		return true;
 	}
@@ -525,7 +1220,7 @@ static bool c0_string_array_equal(C0Array(C0String) a, C0Array(C0String) b) {
 	}
 	usize n = c0array_len(a);
 	for (usize i = 0; i < n; i++) {
-		if (!c0_strings_equal(a[i], b[i])) {
+		if (a[i] != b[i]) {
 			return false;
 		}
 	}
@@ -533,28 +1228,286 @@ static bool c0_string_array_equal(C0Array(C0String) a, C0Array(C0String) b) {
 }
 
 
-static bool c0_types_equal(C0AggType *a, C0AggType *b) {
-	if (a == b) {
-		return true;
+////////////////////////////
+// type interning
+////////////////////////////
+
+static u64 c0_hash_bytes(u64 h, void const *data, usize len) {
+	// FNV-1a
+	u8 const *ptr = (u8 const *)data;
+	for (usize i = 0; i < len; i++) {
+		h ^= ptr[i];
+		h *= 0x100000001b3ull;
 	}
-	if (a->kind == b->kind) {
-		switch (a->kind) {
-		case C0AggType_basic:
-			return a->basic.type == b->basic.type;
-		case C0AggType_array:
-			return a->array.len == b->array.len && a->array.elem == b->array.elem;
-		case C0AggType_record:
-			return c0_strings_equal(a->record.name, b->record.name);
-		case C0AggType_proc:
-			return c0_types_equal(a->proc.ret, b->proc.ret) &&
-			       c0_types_array_equal(a->proc.types, b->proc.types) &&
-			       a->proc.flags == b->proc.flags;
+	return h;
+}
+static u64 c0_hash_u64(u64 h, u64 x) {
+	return c0_hash_bytes(h, &x, sizeof(x));
+}
 
+static u64 c0_type_intern_hash(C0AggType *t) {
+	u64 h = 0xcbf29ce484222325ull;
+	h = c0_hash_u64(h, t->kind);
+	switch (t->kind) {
+	case C0AggType_array:
+		h = c0_hash_u64(h, (u64)(uintptr_t)t->array.elem);
+		h = c0_hash_u64(h, (u64)t->array.len);
+		break;
+	case C0AggType_record:
+		h = c0_hash_bytes(h, t->record.name.text, t->record.name.len);
+		break;
+	case C0AggType_proc:
+		h = c0_hash_u64(h, (u64)(uintptr_t)t->proc.ret);
+		h = c0_hash_u64(h, ((u64)t->proc.call_conv << 16) | (u64)t->proc.flags);
+		for (isize i = 0; i < c0array_len(t->proc.types); i++) {
+			h = c0_hash_u64(h, (u64)(uintptr_t)t->proc.types[i]);
+		}
+		for (isize i = 0; i < c0array_len(t->proc.names); i++) {
+			h = c0_hash_u64(h, (u64)t->proc.names[i].len);
+			h = c0_hash_bytes(h, t->proc.names[i].text, t->proc.names[i].len);
 		}
+		break;
+	}
+	return h;
+}
+
+static bool c0_type_intern_equal(C0AggType *a, C0AggType *b) {
+	if (a->kind != b->kind) {
+		return false;
+	}
+	switch (a->kind) {
+	case C0AggType_array:
+		return a->array.elem == b->array.elem && a->array.len == b->array.len;
+	case C0AggType_record:
+		// records are nominal
+		return c0_strings_equal(a->record.name, b->record.name);
+	case C0AggType_proc:
+		return a->proc.ret == b->proc.ret &&
+		       a->proc.call_conv == b->proc.call_conv &&
+		       a->proc.flags == b->proc.flags &&
+		       c0_types_array_identical(a->proc.types, b->proc.types) &&
+		       c0_string_array_equal(a->proc.names, b->proc.names);
 	}
 	return false;
 }
 
+// Returns the canonical type equal to `key`, or NULL if none exists yet
+static C0AggType *c0_type_intern_find(C0Gen *gen, C0AggType *key, u64 hash) {
+	if (gen->type_table_cap == 0) {
+		return NULL;
+	}
+	usize mask = gen->type_table_cap-1;
+	for (usize i = (usize)hash & mask; ; i = (i+1) & mask) {
+		C0AggType *t = gen->type_table[i];
+		if (t == NULL) {
+			return NULL;
+		}
+		if (c0_type_intern_equal(t, key)) {
+			return t;
+		}
+	}
+}
+
+static void c0_type_intern_insert(C0Gen *gen, C0AggType *t, u64 hash) {
+	if (2*(gen->type_table_len+1) > gen->type_table_cap) {
+		usize old_cap = gen->type_table_cap;
+		C0AggType **old_table = gen->type_table;
+		gen->type_table_cap = old_cap ? 2*old_cap : 256;
+		gen->type_table = (C0AggType **)c0_heap_calloc(sizeof(C0AggType *), gen->type_table_cap);
+		usize mask = gen->type_table_cap-1;
+		for (usize j = 0; j < old_cap; j++) {
+			if (old_table[j] != NULL) {
+				usize i = (usize)c0_type_intern_hash(old_table[j]) & mask;
+				while (gen->type_table[i] != NULL) {
+					i = (i+1) & mask;
+				}
+				gen->type_table[i] = old_table[j];
+			}
+		}
+		c0_heap_free(old_table);
+	}
+	usize mask = gen->type_table_cap-1;
+	usize i = (usize)hash & mask;
+	while (gen->type_table[i] != NULL) {
+		i = (i+1) & mask;
+	}
+	gen->type_table[i] = t;
+	gen->type_table_len += 1;
+	c0array_push(gen->types, t);
+}
+
+// Either returns the existing canonical type equal to `key` or adopts a copy of `key`
+static C0AggType *c0_type_intern(C0Gen *gen, C0AggType *key) {
+	u64 hash = c0_type_intern_hash(key);
+	C0AggType *t = c0_type_intern_find(gen, key, hash);
+	if (t == NULL) {
+		t = c0_arena_new(&gen->arena, C0AggType);
+		*t = *key;
+		c0_type_intern_insert(gen, t, hash);
+	}
+	return t;
+}
+
+static C0InternEntry *c0_intern_entry(C0Gen *gen, C0String str) {
+	u64 hash = c0_hash_bytes(0xcbf29ce484222325ull, str.text, str.len);
+	if (2*(gen->intern_len+1) > gen->intern_cap) {
+		usize old_cap = gen->intern_cap;
+		C0InternEntry *old_entries = gen->intern_entries;
+		gen->intern_cap = old_cap ? 2*old_cap : 256;
+		gen->intern_entries = (C0InternEntry *)c0_heap_calloc(sizeof(C0InternEntry), gen->intern_cap);
+		usize mask = gen->intern_cap-1;
+		for (usize j = 0; j < old_cap; j++) {
+			if (old_entries[j].text.text != NULL) {
+				usize i = (usize)old_entries[j].hash & mask;
+				while (gen->intern_entries[i].text.text != NULL) {
+					i = (i+1) & mask;
+				}
+				gen->intern_entries[i] = old_entries[j];
+			}
+		}
+		c0_heap_free(old_entries);
+	}
+
+	usize mask = gen->intern_cap-1;
+	usize i = (usize)hash & mask;
+	for (;; i = (i+1) & mask) {
+		C0InternEntry *e = &gen->intern_entries[i];
+		if (e->text.text == NULL) {
+			break;
+		}
+		if (e->hash == hash && c0_strings_equal(e->text, str)) {
+			return e;
+		}
+	}
+
+	// interned strings live as long as the generator and are NUL terminated for convenience
+	char *text = (char *)c0_arena_alloc(&gen->arena, str.len+1, 1);
+	memcpy(text, str.text, str.len);
+	C0InternEntry *e = &gen->intern_entries[i];
+	e->text.text = text;
+	e->text.len  = str.len;
+	e->hash      = hash;
+	gen->intern_len += 1;
+	return e;
+}
+
+C0String c0_intern(C0Gen *gen, C0String str) {
+	if (str.len == 0) {
+		C0String empty = {0};
+		return empty;
+	}
+	return c0_intern_entry(gen, str)->text;
+}
+
+C0Proc *c0_gen_find_proc(C0Gen *gen, C0String name) {
+	if (name.len == 0) {
+		return NULL;
+	}
+	return c0_intern_entry(gen, name)->proc;
+}
+
+
+C0AggType *c0_agg_type_array(C0Gen *gen, C0AggType *elem, i64 len) {
+	C0_ASSERT(len >= 0);
+	C0AggType key = {0};
+	key.kind = C0AggType_array;
+	key.array.elem = elem;
+	key.array.len = len;
+	// TODO(bill): size of the array
+	key.size  = len * elem->size;
+	key.align = elem->align;
+	return c0_type_intern(gen, &key);
+}
+
+// Takes ownership of `names` and `types`, which are freed if an equal signature already exists
+C0AggType *c0_agg_type_proc(C0Gen *gen, C0AggType *ret, C0Array(C0String) names, C0Array(C0AggType *) types, C0ProcFlags flags) {
+	if (ret == NULL) {
+		ret = c0_agg_type_basic(gen, C0Basic_void);
+	}
+	C0AggType key = {0};
+	key.kind = C0AggType_proc;
+	key.size = gen->ptr_size;
+	key.align = gen->ptr_size;
+	key.proc.ret = ret;
+	key.proc.names = names;
+	key.proc.types = types;
+	key.proc.flags = flags;
+
+	u64 hash = c0_type_intern_hash(&key);
+	C0AggType *t = c0_type_intern_find(gen, &key, hash);
+	if (t != NULL) {
+		if (t->proc.names != names) {
+			c0array_free(names);
+		}
+		if (t->proc.types != types) {
+			c0array_free(types);
+		}
+	} else {
+		t = c0_arena_new(&gen->arena, C0AggType);
+		*t = key;
+		c0_type_intern_insert(gen, t, hash);
+	}
+	if (t->proc.unnamed == NULL) {
+		if (c0array_len(names) == 0) {
+			t->proc.unnamed = t;
+		} else {
+			key.proc.names = NULL;
+			t->proc.unnamed = c0_type_intern(gen, &key);
+			t->proc.unnamed->proc.unnamed = t->proc.unnamed;
+		}
+	}
+	return t;
+}
+
+// Takes ownership of `names` and `types`, which are freed if the record already exists
+C0AggType *c0_agg_type_record(C0Gen *gen, C0String name, C0Array(C0String) names, C0Array(C0AggType *) types) {
+	C0_ASSERT(name.len != 0);
+	C0_ASSERT(c0array_len(names) == c0array_len(types));
+	C0AggType key = {0};
+	key.kind = C0AggType_record;
+	key.record.name = name;
+
+	u64 hash = c0_type_intern_hash(&key);
+	C0AggType *t = c0_type_intern_find(gen, &key, hash);
+	if (t != NULL) {
+		C0_ASSERT_MSG(c0_string_array_equal(t->record.names, names) && c0_types_array_identical(t->record.types, types),
+		              "record %.*s redeclared with different fields", C0PSTR(name));
+		if (t->record.names != names) {
+			c0array_free(names);
+		}
+		if (t->record.types != types) {
+			c0array_free(types);
+		}
+		return t;
+	}
+
+	t = c0_arena_new(&gen->arena, C0AggType);
+	t->kind = C0AggType_record;
+	t->record.name  = c0_arena_str_dup(&gen->arena, name);
+	t->record.names = names;
+	t->record.types = types;
+
+	i64 size = 0;
+	i64 align = 1;
+	usize n = c0array_len(types);
+	for (usize i = 0; i < n; i++) {
+		C0AggType *ft = types[i];
+		i64 field_align = ft->align > 0 ? ft->align : 1;
+		size = (i64)c0_align_formula((usize)size, (usize)field_align);
+		size += ft->size;
+		if (align < field_align) {
+			align = field_align;
+		}
+		c0array_push(t->record.aligns, field_align);
+	}
+	t->size  = (i64)c0_align_formula((usize)size, (usize)align);
+	t->align = align;
+
+	c0_type_intern_insert(gen, t, hash);
+	return t;
+}
+
+
 static bool c0_types_agg_basic(C0AggType *a, C0BasicType b) {
 	return a && a->kind == C0AggType_basic && c0_basic_unsigned_type[a->basic.type] == c0_basic_unsigned_type[b];
 }
@@ -571,9 +1524,7 @@ static bool c0_types_agg_agg(C0AggType *a, C0AggType *b) {
 	}
 	switch (a->kind) {
 	case C0AggType_proc:
-		return false;
 	case C0AggType_array:
-		return a->array.len == b->array.len && c0_types_agg_agg(a->array.elem, b->array.elem);
 	case C0AggType_record:
 		return false;
 	}
@@ -583,12 +1534,28 @@ static bool c0_types_agg_agg(C0AggType *a, C0AggType *b) {
 
 
 C0Proc *c0_proc_create(C0Gen *gen, C0String name, C0AggType *sig) {
+	C0Proc *p = NULL;
 	C0Arena *arena = &gen->arena;
-	C0Proc *p = c0_arena_new(arena, C0Proc);
+	if (gen->proc_arenas) {
+		C0Arena own_arena = {0};
+		own_arena.minimum_block_size = C0_PROC_ARENA_MINIMUM_BLOCK_SIZE;
+		own_arena.flags = gen->arena.flags;
+		p = c0_arena_new(&own_arena, C0Proc);
+		p->own_arena = own_arena;
+		arena = &p->own_arena;
+	} else {
+		p = c0_arena_new(arena, C0Proc);
+	}
 	C0_ASSERT(p);
 	p->gen = gen;
 	p->arena = arena;
-	p->name  = c0_arena_str_dup(p->arena, name);
+	p->allocator = c0_arena_allocator(arena);
+	p->id = ++gen->next_proc_id;
+	if (name.len != 0) {
+		C0InternEntry *e = c0_intern_entry(gen, name);
+		p->name = e->text;
+		e->proc = p;
+	}
 	C0_ASSERT(sig && sig->kind == C0AggType_proc);
 	p->sig = sig;
 
@@ -601,7 +1568,7 @@ C0Proc *c0_proc_create(C0Gen *gen, C0String name, C0AggType *sig) {
 		C0String name = sig->proc.names[i];
 		if (name.len > 0) {
 			C0Instr *instr = c0_instr_create(p, C0Instr_decl);
-			instr->name = name;
+			instr->name = c0_intern(gen, name);
 			if (type->kind == C0AggType_basic) {
 				instr->basic_type = type->basic.type;
 			} else {
@@ -612,6 +1579,7 @@ C0Proc *c0_proc_create(C0Gen *gen, C0String name, C0AggType *sig) {
 		}
 	}
 
+	c0array_push(gen->procs, p);
 	return p;
 }
 C0Instr *c0_instr_create(C0Proc *p, C0InstrKind kind) {
@@ -634,70 +1602,59 @@ C0Instr *c0_instr_last(C0Proc *p) {
 	return NULL;
 }
 
-static bool c0_is_instruction_any_break(C0Instr *instr, u32 loop_count) {
-	if (instr) {
-		if (instr->kind == C0Instr_break) {
-			return true;
-		}
-		if (instr->kind == C0Instr_loop) {
-			loop_count += 1;
-		}
-
-		if (loop_count > 1) {
-			return false;
-		}
-
-		usize len = c0array_len(instr->nested_instrs);
-		for (usize i = 0; i < len; i++) {
-			if (c0_is_instruction_any_break(instr->nested_instrs[i], loop_count)) {
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
+// O(1) for everything but chains of `else if`, as the facts about nested
+// blocks are cached in their flags when they are popped
 static bool c0_is_instruction_terminating(C0Instr *instr) {
 	if (!instr) {
 		return false;
 	}
-	if (instr->kind == C0Instr_return) {
-		return true;
-	} else if (instr->kind == C0Instr_unreachable) {
+	switch (instr->kind) {
+	case C0Instr_return:
+	case C0Instr_unreachable:
 		return true;
-	} else if (instr->kind == C0Instr_if) {
+	case C0Instr_if:
 		if (instr->args_len != 2) {
 			return false;
 		}
-		bool terminating_if   = false;
-		bool terminating_else = false;
-		if (c0array_len(instr->nested_instrs) == 0) {
+		if ((instr->flags & C0InstrFlag_body_terminating) == 0) {
 			return false;
 		}
-		C0Instr *last_if = c0array_last(instr->nested_instrs);
-		terminating_if = c0_is_instruction_terminating(last_if);
-		terminating_else = c0_is_instruction_terminating(instr->args[1]);
-
-		return terminating_if && terminating_else;
-	} else if (instr->kind == C0Instr_block) {
-		if (c0array_len(instr->nested_instrs) == 0) {
+		return c0_is_instruction_terminating(instr->args[1]);
+	case C0Instr_block:
+		return (instr->flags & C0InstrFlag_body_terminating) != 0;
+	case C0Instr_loop:
+		if (instr->flags & C0InstrFlag_loop_has_break) {
 			return false;
 		}
-		C0Instr *last = c0array_last(instr->nested_instrs);
-		return c0_is_instruction_terminating(last);
-	} else if (instr->kind == C0Instr_loop) {
 		if (c0array_len(instr->nested_instrs) == 0) {
 			return true;
 		}
-		if (c0_is_instruction_any_break(instr, 0)) {
-			return false;
-		}
-		C0Instr *last = c0array_last(instr->nested_instrs);
-		return c0_is_instruction_terminating(last);
+		return (instr->flags & C0InstrFlag_body_terminating) != 0;
 	}
 	return false;
 }
 
+// Recomputes the cached `C0InstrFlag_body_terminating` of a block after its body has changed
+static void c0_block_update_terminating(C0Instr *block) {
+	C0Instr *last = NULL;
+	if (c0array_len(block->nested_instrs) > 0) {
+		last = c0array_last(block->nested_instrs);
+	}
+	if (c0_is_instruction_terminating(last)) {
+		block->flags |= C0InstrFlag_body_terminating;
+	} else {
+		block->flags &= ~C0InstrFlag_body_terminating;
+	}
+}
+
+// instruction lists are bound to the procedure's allocator when first pushed to
+static void c0_instrs_push(C0Proc *p, C0Array(C0Instr *) *array, C0Instr *instr) {
+	if (*array == NULL) {
+		c0array_init(*array, &p->allocator, 8);
+	}
+	c0array_push(*array, instr);
+}
+
 C0Instr *c0_instr_push(C0Proc *p, C0Instr *instr) {
 	if (c0_is_instruction_terminating(c0_instr_last(p))) {
 		c0_warning("next instruction will never be executed");
@@ -706,9 +1663,9 @@ C0Instr *c0_instr_push(C0Proc *p, C0Instr *instr) {
 
 	usize n = c0array_len(p->nested_blocks);
 	if (n > 0) {
-		c0array_push(p->nested_blocks[n-1]->nested_instrs, instr);
+		c0_instrs_push(p, &p->nested_blocks[n-1]->nested_instrs, instr);
 	} else {
-		c0array_push(p->instrs, instr);
+		c0_instrs_push(p, &p->instrs, instr);
 	}
 	return instr;
 }
@@ -734,6 +1691,7 @@ C0Instr *c0_pop_nested_block(C0Proc *p) {
 	C0_ASSERT(n > 0);
 	C0Instr *block = p->nested_blocks[n-1];
 	c0array_pop(p->nested_blocks);
+	c0_block_update_terminating(block);
 	return block;
 }
 
@@ -752,12 +1710,14 @@ C0Instr *c0_push_basic_i8(C0Proc *p, i8 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_i8;
 	val->value_i64 = (i64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 C0Instr *c0_push_basic_u8(C0Proc *p, u8 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_u8;
 	val->value_u64 = (u64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 
@@ -765,12 +1725,14 @@ C0Instr *c0_push_basic_i16(C0Proc *p, i16 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_i16;
 	val->value_i64 = (i64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 C0Instr *c0_push_basic_u16(C0Proc *p, u16 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_u32;
 	val->value_u64 = (u64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 
@@ -778,12 +1740,14 @@ C0Instr *c0_push_basic_i32(C0Proc *p, i32 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_i32;
 	val->value_i64 = (i64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 C0Instr *c0_push_basic_u32(C0Proc *p, u32 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_u32;
 	val->value_u64 = (u64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 
@@ -791,12 +1755,14 @@ C0Instr *c0_push_basic_i64(C0Proc *p, i64 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_i64;
 	val->value_i64 = (i64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 C0Instr *c0_push_basic_u64(C0Proc *p, u64 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_u64;
 	val->value_u64 = (u64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 
@@ -804,15 +1770,31 @@ C0Instr *c0_push_basic_ptr(C0Proc *p, u64 value) {
 	C0Instr *val = c0_instr_create(p, C0Instr_decl);
 	val->basic_type = C0Basic_ptr;
 	val->value_u64 = (u64)value;
+	val->flags |= C0InstrFlag_constant;
 	return c0_instr_push(p, val);
 }
 
 
+static bool c0_fold_instr(C0Instr *instr);
+static bool c0_is_within_a_loop(C0Proc *p);
+
+// Pushes an instruction which may be replaced with a constant when `fold_on_push` is enabled
+// a constant may still be stored to later on, which only matters if control can flow back
+// to this point, so nothing within a loop or after a label (the target of any `goto`) is folded early
+static C0Instr *c0_instr_push_foldable(C0Proc *p, C0Instr *instr) {
+	if (p->gen->fold_on_push && !c0_is_within_a_loop(p) && c0array_len(p->labels) == 0) {
+		c0_fold_instr(instr);
+	}
+	return c0_instr_push(p, instr);
+}
+
 static void c0_alloc_args(C0Proc *p, C0Instr *instr, isize len) {
 	typedef C0Instr *T;
 	instr->args_len = len;
-	if (len != 0) {
+	if (len > C0_INLINE_ARGS) {
 		instr->args = (T *)c0_arena_alloc(p->arena, sizeof(T)*len, alignof(T));
+	} else if (len != 0) {
+		instr->args = instr->inline_args;
 	}
 
 }
@@ -831,7 +1813,7 @@ C0Instr *c0_push_bin(C0Proc *p, C0InstrKind kind, C0BasicType type, C0Instr *lef
 	c0_alloc_args(p, bin, 2);
 	bin->args[0] = c0_use(left);
 	bin->args[1] = c0_use(right);
-	return c0_instr_push(p, bin);
+	return c0_instr_push_foldable(p, bin);
 }
 
 #define C0_PUSH_BIN_INT_DEF(name) C0Instr *c0_push_##name(C0Proc *p, C0Instr *left, C0Instr *right) { \
@@ -892,7 +1874,7 @@ C0_PUSH_BIN_FLOAT_DEF(gteqf);
 	C0Instr *val = c0_instr_create(p, C0Instr_##name##_i8 + (arg->basic_type - C0Basic_i8)); \
 	c0_alloc_args(p, val, 1); \
 	val->args[0] = c0_use(arg); \
-	return c0_instr_push(p, val); \
+	return c0_instr_push_foldable(p, val); \
 }
 
 #define C0_PUSH_UN_UINT_DEF(name) C0Instr *c0_push_##name(C0Proc *p, C0Instr *arg) { \
@@ -901,7 +1883,7 @@ C0_PUSH_BIN_FLOAT_DEF(gteqf);
 	val->basic_type = arg->basic_type; \
 	c0_alloc_args(p, val, 1); \
 	val->args[0] = c0_use(arg); \
-	return c0_instr_push(p, val); \
+	return c0_instr_push_foldable(p, val); \
 }
 
 C0_PUSH_UN_UINT_DEF(clz);
@@ -915,7 +1897,7 @@ C0_PUSH_UN_UINT_DEF(popcnt);
 	C0Instr *val = c0_instr_create(p, C0Instr_##name##_f16 + (arg->basic_type - C0Basic_f16)); \
 	c0_alloc_args(p, val, 1); \
 	val->args[0] = c0_use(arg); \
-	return c0_instr_push(p, val); \
+	return c0_instr_push_foldable(p, val); \
 }
 
 C0_PUSH_UN_FLOAT_DEF(absf);
@@ -1042,7 +2024,7 @@ C0Instr *c0_push_convert(C0Proc *p, C0BasicType type, C0Instr *arg) {
 	c0_alloc_args(p, cvt, 1);
 	cvt->args[0] = c0_use(arg);
 	cvt->basic_type = type;
-	return c0_instr_push(p, cvt);
+	return c0_instr_push_foldable(p, cvt);
 }
 C0Instr *c0_push_reinterpret_basic(C0Proc *p, C0BasicType type, C0Instr *arg) {
 	C0_ASSERT(type != C0Basic_void);
@@ -1057,7 +2039,7 @@ C0Instr *c0_push_reinterpret_basic(C0Proc *p, C0BasicType type, C0Instr *arg) {
 	c0_alloc_args(p, rip, 1);
 	rip->args[0] = c0_use(arg);
 	rip->basic_type = type;
-	return c0_instr_push(p, rip);
+	return c0_instr_push_foldable(p, rip);
 }
 
 C0Instr *c0_push_load_basic(C0Proc *p, C0BasicType type, C0Instr *arg) {
@@ -1111,6 +2093,8 @@ C0Instr *c0_push_load_basic(C0Proc *p, C0BasicType type, C0Instr *arg) {
 
 C0Instr *c0_push_addr_of_decl(C0Proc *p, C0Instr *decl) {
 	C0_ASSERT(decl->kind == C0Instr_decl);
+	decl->flags &= ~C0InstrFlag_constant; // may be written through the pointer
+	decl->flags |= C0InstrFlag_addr_taken;
 	C0Instr *instr = c0_instr_create(p, C0Instr_addr);
 	c0_alloc_args(p, instr, 1);
 	instr->args[0] = c0_use(decl);
@@ -1142,14 +2126,9 @@ C0Instr *c0_push_field_ptr(C0Proc *p, C0AggType *record_type, C0Instr *record_pt
 	return c0_instr_push(p, instr);
 }
 
-C0Instr *c0_push_store_basic(C0Proc *p, C0Instr *dst, C0Instr *src) {
-	if (dst->kind == C0Instr_decl) {
-		dst = c0_push_addr_of_decl(p, dst);
-	}
-	C0_ASSERT(dst->basic_type == C0Basic_ptr);
-
+static C0InstrKind c0_instr_store_kind(C0BasicType type) {
 	C0InstrKind kind = C0Instr_store_u8;
-	switch (src->basic_type) {
+	switch (type) {
 	case C0Basic_i8:
 	case C0Basic_u8:
 		kind = C0Instr_store_u8;
@@ -1183,8 +2162,16 @@ C0Instr *c0_push_store_basic(C0Proc *p, C0Instr *dst, C0Instr *src) {
 		kind = C0Instr_store_ptr;
 		break;
 	}
+	return kind;
+}
 
-	C0Instr *instr = c0_instr_create(p, kind);
+C0Instr *c0_push_store_basic(C0Proc *p, C0Instr *dst, C0Instr *src) {
+	if (dst->kind == C0Instr_decl) {
+		dst = c0_push_addr_of_decl(p, dst);
+	}
+	C0_ASSERT(dst->basic_type == C0Basic_ptr);
+
+	C0Instr *instr = c0_instr_create(p, c0_instr_store_kind(src->basic_type));
 	instr->basic_type = C0Basic_void;
 
 	c0_alloc_args(p, instr, 2);
@@ -1356,7 +2343,7 @@ C0Instr *c0_push_decl_basic_with_alignment(C0Proc *p, C0BasicType type, C0String
 	C0_ASSERT((alignment & (alignment-1)) == 0);
 	C0_ASSERT(type != C0Basic_void);
 	C0Instr *instr = c0_instr_create(p, C0Instr_decl);
-	instr->name = name;
+	instr->name = c0_intern(p->gen, name);
 	instr->basic_type = type;
 	instr->alignment = alignment;
 	return c0_instr_push(p, instr);
@@ -1364,7 +2351,7 @@ C0Instr *c0_push_decl_basic_with_alignment(C0Proc *p, C0BasicType type, C0String
 C0Instr *c0_push_decl_basic(C0Proc *p, C0BasicType type, C0String name) {
 	C0_ASSERT(type != C0Basic_void);
 	C0Instr *instr = c0_instr_create(p, C0Instr_decl);
-	instr->name = name;
+	instr->name = c0_intern(p->gen, name);
 	instr->basic_type = type;
 	return c0_instr_push(p, instr);
 }
@@ -1376,7 +2363,7 @@ C0Instr *c0_push_decl_agg_with_alignment(C0Proc *p, C0AggType *type, C0String na
 		return c0_push_decl_basic_with_alignment(p, type->basic.type, name, alignment);
 	}
 	C0Instr *instr = c0_instr_create(p, C0Instr_decl);
-	instr->name = name;
+	instr->name = c0_intern(p->gen, name);
 	instr->agg_type = type;
 	instr->alignment = alignment;
 	return c0_instr_push(p, instr);
@@ -1387,7 +2374,7 @@ C0Instr *c0_push_decl_agg(C0Proc *p, C0AggType *type, C0String name) {
 		return c0_push_decl_basic(p, type->basic.type, name);
 	}
 	C0Instr *instr = c0_instr_create(p, C0Instr_decl);
-	instr->name = name;
+	instr->name = c0_intern(p->gen, name);
 	instr->agg_type = type;
 	return c0_instr_push(p, instr);
 }
@@ -1406,17 +2393,21 @@ C0Instr *c0_push_select_basic(C0Proc *p, C0Instr *cond, C0Instr *true_case, C0In
 	instr->args[0] = c0_use(cond);
 	instr->args[1] = c0_use(true_case);
 	instr->args[2] = c0_use(false_case);
-	return c0_instr_push(p, instr);
+	return c0_instr_push_foldable(p, instr);
 }
 
-static bool c0_is_within_a_loop(C0Proc *p) {
+static C0Instr *c0_innermost_loop(C0Proc *p) {
 	usize n = c0array_len(p->nested_blocks);
 	for (usize i = n-1; i < n; i--) {
 		if (p->nested_blocks[i]->kind == C0Instr_loop) {
-			return true;
+			return p->nested_blocks[i];
 		}
 	}
-	return false;
+	return NULL;
+}
+
+static bool c0_is_within_a_loop(C0Proc *p) {
+	return c0_innermost_loop(p) != NULL;
 }
 
 C0Instr *c0_push_continue(C0Proc *p) {
@@ -1425,9 +2416,14 @@ C0Instr *c0_push_continue(C0Proc *p) {
 	return c0_instr_push(p, instr);
 }
 C0Instr *c0_push_break(C0Proc *p) {
-	C0_ASSERT(c0_is_within_a_loop(p));
+	C0Instr *loop = c0_innermost_loop(p);
+	C0_ASSERT(loop != NULL);
 	C0Instr *instr = c0_instr_create(p, C0Instr_break);
-	return c0_instr_push(p, instr);
+	instr = c0_instr_push(p, instr);
+	if (instr) {
+		loop->flags |= C0InstrFlag_loop_has_break;
+	}
+	return instr;
 }
 
 C0Instr *c0_push_goto(C0Proc *p, C0Instr *label) {
@@ -1440,13 +2436,12 @@ C0Instr *c0_push_goto(C0Proc *p, C0Instr *label) {
 C0Instr *c0_push_label(C0Proc *p, C0String name) {
 	// TODO(bill): make name unique if it isn't
 	C0Instr *instr = c0_instr_create(p, C0Instr_label);
-	instr->name = c0_arena_str_dup(p->arena, name);
-	usize n = c0array_len(p->labels);
-	for (usize i = 0; i < n; i++) {
-		if (!c0_strings_equal(p->labels[i]->name, name)) {
-			c0_errorf("non-unique label names: %.*s", C0PSTR(name));
-		}
+	C0InternEntry *e = c0_intern_entry(p->gen, name);
+	if (e->label_proc_id == p->id) {
+		c0_errorf("non-unique label names: %.*s", C0PSTR(name));
 	}
+	e->label_proc_id = p->id;
+	instr->name = e->text;
 	c0array_push(p->labels, instr);
 	return c0_instr_push(p, instr);
 }
@@ -1541,38 +2536,91 @@ void c0_block_else_block(C0Proc *p, C0Instr *if_stmt) {
 }
 
 
-void c0_pass_remove_unused_instructions(C0Array(C0Instr *) *array) {
-	if (!array || !*array) {
-		return;
-	}
-	usize len = c0array_len((*array));
-	for (isize i = len-1; i >= 0; i--) {
-		C0Instr *instr = (*array)[i];
-		if (instr->nested_instrs) {
-			c0_pass_remove_unused_instructions(&instr->nested_instrs);
+static bool c0_instr_is_removable_value(C0Instr *instr) {
+	return instr->basic_type != C0Basic_void && instr->kind != C0Instr_call;
+}
+
+// Releases the arguments of a dead instruction and transitively kills any which become unused
+static void c0_dce_release_args(C0Array(C0Instr *) *worklist, C0Instr *instr) {
+	c0array_push(*worklist, instr);
+	while (c0array_len(*worklist) > 0) {
+		C0Instr *dead = c0array_last(*worklist);
+		c0array_pop(*worklist);
+		isize args_len = dead->args_len;
+		if (dead->kind == C0Instr_if) {
+			args_len = 1; // only the condition, the else block is not a value
 		}
-		if (instr->basic_type != C0Basic_void) {
-			if (instr->kind == C0Instr_call) {
-				continue;
-			}
-			if (instr->uses == 0) {
-				for (isize j = 0; j < instr->args_len; j++) {
-					c0_unuse(instr->args[j]);
-				}
-				c0array_ordered_remove((*array), i);
-				continue;
-			}
-		} else if (instr->kind == C0Instr_if) {
-			if (c0array_len(instr->nested_instrs) == 0) {
-				if (instr->args_len == 1) {
-					c0array_ordered_remove((*array), i);
-					continue;
-				}
+		for (isize j = 0; j < args_len; j++) {
+			C0Instr *arg = c0_unuse(dead->args[j]);
+			if (arg->uses == 0 && (arg->flags & C0InstrFlag_dead) == 0 && c0_instr_is_removable_value(arg)) {
+				arg->flags |= C0InstrFlag_dead;
+				c0array_push(*worklist, arg);
 			}
 		}
 	}
 }
 
+static void c0_dce_sweep(C0Array(C0Instr *) *worklist, C0Array(C0Instr *) array);
+
+// instructions which die during the sweep always precede their (dead) users in
+// program order, so sweeping backwards means each array only needs a single pass
+static bool c0_dce_sweep_instr(C0Array(C0Instr *) *worklist, C0Instr *instr) {
+	if (instr->flags & C0InstrFlag_dead) {
+		return false;
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		C0Instr *else_stmt = instr->args[1];
+		bool keep_else = c0_dce_sweep_instr(worklist, else_stmt);
+		if (!keep_else || (else_stmt->kind == C0Instr_block && c0array_len(else_stmt->nested_instrs) == 0)) {
+			instr->args_len = 1;
+		}
+	}
+	if (instr->nested_instrs) {
+		c0_dce_sweep(worklist, instr->nested_instrs);
+		c0_block_update_terminating(instr);
+	}
+
+	if (c0_instr_is_removable_value(instr)) {
+		if (instr->uses == 0) {
+			instr->flags |= C0InstrFlag_dead;
+			c0_dce_release_args(worklist, instr);
+			return false;
+		}
+	} else if (instr->kind == C0Instr_if) {
+		if (c0array_len(instr->nested_instrs) == 0 && instr->args_len == 1) {
+			instr->flags |= C0InstrFlag_dead;
+			c0_dce_release_args(worklist, instr);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void c0_dce_sweep(C0Array(C0Instr *) *worklist, C0Array(C0Instr *) array) {
+	isize len = c0array_len(array);
+	isize w = len;
+	for (isize i = len-1; i >= 0; i--) {
+		C0Instr *instr = array[i];
+		if (c0_dce_sweep_instr(worklist, instr)) {
+			array[--w] = instr;
+		}
+	}
+	if (w != 0) {
+		memmove(&array[0], &array[w], (len-w)*sizeof(array[0]));
+		c0array_meta(array)->len = len-w;
+	}
+}
+
+// Dead code elimination, linear in the number of instructions
+void c0_pass_remove_unused_instructions(C0Array(C0Instr *) *array) {
+	if (!array || !*array) {
+		return;
+	}
+	C0Array(C0Instr *) worklist = NULL;
+	c0_dce_sweep(&worklist, *array);
+	c0array_free(worklist);
+}
+
 void c0_assign_reg_id(C0Instr *instr, u32 *reg_id_) {
 	i32 arg_count = c0_instr_arg_count[instr->kind];
 	if (arg_count >= 0) {
@@ -1632,10 +2680,32 @@ void c0_register_instr_to_gen(C0Gen *gen, C0Instr *instr) {
 }
 
 
+void c0_pass_inline_calls(C0Proc *p);
+void c0_pass_tail_calls(C0Proc *p);
+void c0_pass_fold_constants(C0Array(C0Instr *) array);
+void c0_pass_value_numbering(C0Array(C0Instr *) array);
+
+static isize c0_instr_count(C0Instr *instr) {
+	isize count = 1;
+	for (isize i = 0; i < c0array_len(instr->nested_instrs); i++) {
+		count += c0_instr_count(instr->nested_instrs[i]);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		count += c0_instr_count(instr->args[1]);
+	}
+	return count;
+}
+
 C0Proc *c0_proc_finish(C0Proc *p) {
 	C0_ASSERT(p->gen);
 	C0_ASSERT(c0array_len(p->nested_blocks) == 0);
 
+	c0_pass_inline_calls(p);
+	if (p->gen->tail_calls) {
+		c0_pass_tail_calls(p);
+	}
+	c0_pass_fold_constants(p->instrs);
+	c0_pass_value_numbering(p->instrs);
 	c0_pass_remove_unused_instructions(&p->instrs);
 
 	C0Instr *last = c0_instr_last(p);
@@ -1649,13 +2719,18 @@ C0Proc *c0_proc_finish(C0Proc *p) {
 
 	u32 reg_id = 0;
 
+	p->instr_count = 0;
 	for (isize i = 0; i < c0array_len(p->instrs); i++) {
 		C0Instr *instr = p->instrs[i];
 		c0_assign_reg_id(instr, &reg_id);
 		c0_register_instr_to_gen(p->gen, instr);
+		p->instr_count += c0_instr_count(instr);
 	}
+	p->finished = true;
 	return p;
 }
 
 
+#include "c0_pass.c"
+#include "c0_compact.c"
 #include "c0_print.c"
@@ -93,10 +93,25 @@ static void c0_assert_handler(char const *prefix, char const *condition, char co
 #define C0PSTR(s) (int)(s).len, (s).text
 #endif
 
+// `new_size == 0` frees `old_ptr`, `old_ptr == NULL` allocates zeroed memory
+typedef void *(*C0AllocatorProc)(void *data, void *old_ptr, usize old_size, usize new_size, usize alignment);
+
+struct C0Allocator {
+	C0AllocatorProc proc;
+	void *          data;
+};
+
+void *c0_allocator_alloc (C0Allocator *a, usize size, usize alignment);
+void *c0_allocator_resize(C0Allocator *a, void *ptr, usize old_size, usize new_size, usize alignment);
+void  c0_allocator_free  (C0Allocator *a, void *ptr, usize size);
+
+C0Allocator c0_heap_allocator(void);
+
 struct C0Array {
 	alignas(2*sizeof(isize))
 	isize len;
 	isize cap;
+	C0Allocator *allocator; // NULL uses the heap
 };
 
 #define C0Array(T) T *
@@ -105,6 +120,10 @@ struct C0Array {
 	(&((C0Array*)(array))[-1])
 
 
+// binds an empty array to `allocator_`, which must outlive it
+#define c0array_init(array, allocator_, cap_) \
+	c0array_init_internal((void **)&(array), (allocator_), (cap_), sizeof(*(array)))
+
 #define c0array_len(array) \
 	((array) ? c0array_meta(array)->len : 0)
 
@@ -162,6 +181,7 @@ struct C0Array {
 
 bool c0array_grow_internal(void **const array, usize elements, usize type_size);
 void c0array_delete(void *const array);
+bool c0array_init_internal(void **const array, C0Allocator *allocator, usize cap, usize type_size);
 
 struct C0MemoryBlock {
 	C0MemoryBlock *prev;
@@ -170,16 +190,73 @@ struct C0MemoryBlock {
 	usize          used;
 };
 
+// Block policy of an arena, only applies to blocks allocated after it is set
+typedef u32 C0ArenaFlags;
+enum C0ArenaFlags_enum {
+	// skip the protected page after each block which catches overflows
+	C0ArenaFlag_no_guard_pages = 1<<0,
+	// ask for transparent huge pages, useful for large IR arenas (Linux only)
+	C0ArenaFlag_huge_pages     = 1<<1,
+	// allow `c0_arena_alloc` from several threads at once (marks and `c0_arena_try_grow` are not allowed)
+	// freeing the arena must still only happen once no other thread is using it
+	C0ArenaFlag_thread_safe    = 1<<2,
+};
+
 struct C0Arena {
 	C0MemoryBlock *curr_block;
 	usize minimum_block_size;
+	C0ArenaFlags flags;
 	// TODO(bill): use an arena here
+
+	// only used with `C0ArenaFlag_thread_safe`
+	u32   lock;
+	usize generation;
+
+	// see `c0_arena_init_reserve`, only the first `committed` bytes of the range are usable
+	C0MemoryBlock *reserved_block;
+	usize          committed;
 };
 
 
 void *c0_arena_alloc   (C0Arena *arena, usize min_size, usize alignment);
 void  c0_arena_free_all(C0Arena *arena);
 
+// Reserves one contiguous range of address space (0 for the default size) and commits
+// pages from it as the arena grows, rather than mapping a new block each time
+void  c0_arena_init_reserve(C0Arena *arena, usize reserve_size);
+// Grows the most recent allocation `ptr` in place if there is room
+bool  c0_arena_try_grow    (C0Arena *arena, void *ptr, usize old_size, usize new_size);
+// Frees everything and releases the reserved range, if any
+void  c0_arena_destroy     (C0Arena *arena);
+
+// Bump-and-copy allocator, freeing does nothing and the last allocation grows in place
+C0Allocator c0_arena_allocator(C0Arena *arena);
+
+// Temporary memory scope: everything allocated after `c0_arena_mark` is freed by `c0_arena_rewind`
+typedef struct C0ArenaTemp C0ArenaTemp;
+struct C0ArenaTemp {
+	C0Arena *      arena;
+	C0MemoryBlock *block;
+	usize          used;
+};
+
+C0ArenaTemp c0_arena_mark  (C0Arena *arena);
+void        c0_arena_rewind(C0ArenaTemp temp);
+
+// Per-thread scratch arenas for short lived allocations
+// Each one reserves its own 4 GiB range of address space on first use, in every thread that uses it
+// `conflict` is an arena already in use by the caller (may be NULL), which will not be returned
+C0ArenaTemp c0_scratch_begin  (C0Arena *conflict);
+void        c0_scratch_end    (C0ArenaTemp temp);
+// Releases the scratch arenas of the calling thread
+void        c0_scratch_destroy(void);
+
+// Blocks freed by arenas are kept in a process-wide pool and handed out again to later arenas
+// rather than being unmapped, up to `max_bytes` in total (0 disables the pool)
+void c0_block_pool_set_capacity(usize max_bytes);
+// Unmaps pooled blocks until at most `max_bytes` remain in the pool
+void c0_block_pool_trim(usize max_bytes);
+
 #ifndef c0_arena_new
 #define c0_arena_new(arena, T) (T *)c0_arena_alloc((arena), sizeof(T), alignof(T))
 #endif
@@ -328,17 +405,40 @@ enum C0EndianKind_enum {
 	C0Endian_big    = 1,
 };
 
+typedef struct C0InternEntry C0InternEntry;
+struct C0InternEntry {
+	C0String text;
+	u64      hash;
+	C0Proc * proc;          // the procedure with this name, see `c0_gen_find_proc`
+	u32      label_proc_id; // the last procedure which declared a label with this name
+};
+
 struct C0Gen {
 	C0String name;
 	C0Arena  arena;
 
 	i64 ptr_size;
 	C0EndianKind endian;
+	bool fold_on_push; // evaluate instructions with constant arguments as they are pushed, until the first label
+	bool tail_calls;   // turn self tail calls into loops in `c0_proc_finish`
+	i32  inline_threshold; // procedures with at most this many instructions are inlined into their callers (0 only inlines `C0ProcFlag_always_inline` ones)
+	bool proc_arenas; // each procedure owns an arena which is freed by `c0_proc_destroy`
 
 	C0Array(C0String)    files;
 	C0Array(C0AggType *) types;
 	C0Array(C0Proc *)    procs;
 
+	// hash-consed aggregate types, see `c0_type_intern`
+	C0AggType **type_table;
+	usize       type_table_len;
+	usize       type_table_cap;
+
+	// interned identifiers, see `c0_intern`
+	C0InternEntry *intern_entries;
+	usize          intern_len;
+	usize          intern_cap;
+	u32            next_proc_id;
+
 	C0AggType *basic_agg[C0Basic_COUNT];
 
 	u8 instrs_to_generate[C0Instr_COUNT];
@@ -354,24 +454,27 @@ struct C0Loc {
 
 typedef u32 C0InstrFlags;
 enum C0InstrFlags_enum {
+	// cached facts about a block, updated when it is popped (see `c0_pop_nested_block`)
+	C0InstrFlag_body_terminating = 1u<<0u, // the last instruction of `nested_instrs` is terminating
+	C0InstrFlag_loop_has_break   = 1u<<1u, // a `break` targets this loop
+
+	C0InstrFlag_dead       = 1u<<2u, // removed by dead code elimination
+	C0InstrFlag_constant   = 1u<<3u, // a `decl` holding a known value which is never written to
+	C0InstrFlag_addr_taken = 1u<<4u, // a `decl` which may be written to through a pointer
+
 	C0InstrFlag_print_inline = 1u<<16u,
 };
 
+enum { C0_INLINE_ARGS = 3 }; // most instructions take at most this many arguments
+
 struct C0Instr {
 	C0InstrKind  kind;
 	C0BasicType  basic_type;
 	u16          padding0;
 	u32          uses;
 	u32          alignment; // optional
-	C0Instr *    parent;
 	C0InstrFlags flags;
-
-	C0AggType *agg_type; // if set, overrides `basic_type`
-
-	u32      id;
-	C0String name;
-	C0Proc    *call_proc;
-	C0AggType *call_sig;
+	u32          id;
 
 	/*
 		unary expression:  args_len == 1
@@ -399,8 +502,16 @@ struct C0Instr {
 		return statement
 			args[0] : return value (if exists)
 	*/
-	C0Instr **args;
+	C0Instr **args;     // points to `inline_args` unless there are more than `C0_INLINE_ARGS`
 	isize     args_len;
+	C0Instr * inline_args[C0_INLINE_ARGS];
+
+	C0Instr *    parent;
+	C0AggType *agg_type; // if set, overrides `basic_type`
+
+	C0String name;
+	C0Proc    *call_proc;
+	C0AggType *call_sig;
 
 	/*
 		block
@@ -419,18 +530,36 @@ struct C0Instr {
 	};
 };
 
+typedef u8 C0ProcLinkage;
+enum C0ProcLinkage_enum {
+	C0ProcLinkage_public,
+	C0ProcLinkage_private, // not visible outside of the object (`static` in C)
+};
+
 struct C0Proc {
-	C0Arena *  arena;
+	C0Arena *  arena; // either `&gen->arena` or `&own_arena`
 	C0Gen *    gen;
-	C0String   name;
+	C0String   name; // interned
+	u32        id;   // unique within `gen`, never reused
 	C0AggType *sig;
 	void *     user_data;
 
+	C0ProcLinkage linkage;
+
 	C0Array(C0Instr *) parameters;
 	C0Array(C0Instr *) instrs;
 	C0Array(C0Instr *) nested_blocks;
 	C0Array(C0Instr *) labels;
 
+	// instruction lists of the procedure live in its arena, see `c0_instrs_push`
+	C0Allocator allocator;
+
+	// see `C0Gen.proc_arenas`, the procedure itself is allocated from it too
+	C0Arena own_arena;
+
+	// set by `c0_proc_finish`, a finished procedure may be inlined into its callers
+	bool  finished;
+	isize instr_count;
 };
 
 typedef u32 C0AggTypeKind;
@@ -484,6 +613,8 @@ struct C0AggType {
 
 			C0ProcCallConv call_conv;
 			C0ProcFlags    flags;
+
+			C0AggType *unnamed; // canonical signature without parameter names
 		} proc;
 	};
 };
@@ -493,7 +624,14 @@ void c0_platform_virtual_memory_init(void);
 void c0_gen_init(C0Gen *gen);
 void c0_gen_destroy(C0Gen *gen);
 
-C0Proc * c0_proc_create (C0Gen *gen, C0String name);
+// Returns the canonical copy of `str`, interned strings are equal if and only if their `text` pointers are
+C0String c0_intern(C0Gen *gen, C0String str);
+C0Proc * c0_gen_find_proc(C0Gen *gen, C0String name);
+
+C0Proc * c0_proc_create (C0Gen *gen, C0String name, C0AggType *sig);
+// Removes `p` from `gen->procs` and frees it, along with its instructions if it owns its arena
+// any call to `p` from another procedure must be gone first
+void     c0_proc_destroy(C0Proc *p);
 C0Instr *c0_instr_create(C0Proc *p,  C0InstrKind kind);
 C0Instr *c0_instr_push  (C0Proc *p,  C0Instr *instr);
 
@@ -539,4 +677,58 @@ C0Instr *c0_push_label(C0Proc *p, C0String name);
 C0Instr *c0_push_if(C0Proc *p, C0Instr *cond);
 C0Instr *c0_push_loop(C0Proc *p);
 
+
+// Compact form of a procedure (see c0_compact.c)
+// Instructions live in flat arrays indexed by `C0Ref`: the parameters first, then the body in
+// pre-order. A block, loop or if is directly followed by its body and `args[2]` is the end of
+// it (including the else chain of an if), the else of an if is `args[1]`
+typedef u32 C0Ref; // 0 is the null reference
+
+enum { C0_COMPACT_SPILLED = 0xff }; // `args_len` when the `args[1]` arguments start at `extra_args[args[0]]`
+
+typedef struct C0CompactInstr C0CompactInstr;
+struct C0CompactInstr {
+	C0InstrKind kind;
+	C0BasicType basic_type;
+	u8          args_len;
+	C0Ref       args[C0_INLINE_ARGS];
+};
+
+typedef struct C0CompactCold C0CompactCold;
+struct C0CompactCold {
+	C0String   name;
+	C0AggType *agg_type;
+	C0Proc *   call_proc;
+	C0AggType *call_sig;
+	u32        alignment;
+	u64        value;
+};
+
+typedef struct C0CompactProc C0CompactProc;
+struct C0CompactProc {
+	C0String   name;
+	C0AggType *sig;
+	bool       finished;
+	isize      instr_count;
+	u32        param_count; // the parameters are [1, param_count]
+
+	// indexed by `C0Ref`
+	C0Array(C0CompactInstr) instrs;
+	C0Array(C0InstrFlags)   flags;
+	C0Array(u32)            uses;
+	C0Array(u32)            cold; // index into `colds`, 0 if there is nothing cold
+
+	C0Array(C0CompactCold)  colds;
+	C0Array(C0Ref)          extra_args;
+};
+
+void   c0_compact_from_proc(C0CompactProc *c, C0Proc *p);
+// Rebuilds the body of `p`, which must have the same parameters as the procedure `c` came from
+void   c0_compact_to_proc  (C0CompactProc *c, C0Proc *p);
+void   c0_compact_destroy  (C0CompactProc *c);
+
+C0Ref  c0_compact_next     (C0CompactProc *c, C0Ref ref);   // the next instruction in the same body
+C0Ref  c0_compact_body_end (C0CompactProc *c, C0Ref block); // the body of `block` is [block+1, end)
+C0Ref *c0_compact_args     (C0CompactProc *c, C0Ref ref, isize *args_len);
+
 #endif /*C0_HEADER_DEFINE*/
\ No newline at end of file
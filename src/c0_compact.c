@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+// Compact IR
+//
+// A procedure flattened into arrays indexed by `C0Ref`. The hot part of an
+// instruction (kind, type and arguments) is 16 bytes and everything rarely
+// needed lives in `colds`, which only instructions with a name, a value, an
+// aggregate type, an alignment or a call target have.
+//
+// Conversion goes through two walks in both directions as a `goto` may refer
+// to a label which comes later on.
+///////////////////////////////////////////////////////////////////////////////
+
+static bool c0_compact_is_block(C0InstrKind kind) {
+	return kind == C0Instr_if || kind == C0Instr_loop || kind == C0Instr_block;
+}
+
+C0Ref c0_compact_body_end(C0CompactProc *c, C0Ref block) {
+	C0CompactInstr *instr = &c->instrs[block];
+	C0_ASSERT(c0_compact_is_block(instr->kind));
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		return instr->args[1];
+	}
+	return instr->args[2];
+}
+
+C0Ref c0_compact_next(C0CompactProc *c, C0Ref ref) {
+	C0CompactInstr *instr = &c->instrs[ref];
+	if (c0_compact_is_block(instr->kind)) {
+		return instr->args[2];
+	}
+	return ref+1;
+}
+
+C0Ref *c0_compact_args(C0CompactProc *c, C0Ref ref, isize *args_len) {
+	C0CompactInstr *instr = &c->instrs[ref];
+	if (instr->args_len == C0_COMPACT_SPILLED) {
+		*args_len = instr->args[1];
+		return &c->extra_args[instr->args[0]];
+	}
+	*args_len = instr->args_len;
+	return instr->args;
+}
+
+static C0Ref c0_compact_ref(C0InstrMap *refs, C0Instr *instr) {
+	C0Ref ref = (C0Ref)(uintptr_t)c0_instr_map_get(refs, instr);
+	C0_ASSERT(ref != 0 && "argument is not part of the procedure");
+	return ref;
+}
+
+static C0Ref c0_compact_emit(C0CompactProc *c, C0InstrMap *refs, C0Array(C0Instr *) *order, C0Instr *instr) {
+	C0Ref ref = (C0Ref)c0array_len(c->instrs);
+	c0_instr_map_set(refs, instr, (C0Instr *)(uintptr_t)ref);
+	c0array_push(*order, instr);
+
+	C0CompactInstr hot = {0};
+	hot.kind       = instr->kind;
+	hot.basic_type = instr->basic_type;
+	c0array_push(c->instrs, hot);
+	c0array_push(c->flags, instr->flags);
+	c0array_push(c->uses, instr->uses);
+
+	u32 cold_index = 0;
+	if (instr->name.len != 0 || instr->agg_type || instr->call_proc || instr->call_sig ||
+	    instr->alignment != 0 || instr->value_u64 != 0) {
+		C0CompactCold cold = {0};
+		cold.name      = instr->name;
+		cold.agg_type  = instr->agg_type;
+		cold.call_proc = instr->call_proc;
+		cold.call_sig  = instr->call_sig;
+		cold.alignment = instr->alignment;
+		cold.value     = instr->value_u64;
+		cold_index = (u32)c0array_len(c->colds);
+		c0array_push(c->colds, cold);
+	}
+	c0array_push(c->cold, cold_index);
+	return ref;
+}
+
+static void c0_compact_emit_block(C0CompactProc *c, C0InstrMap *refs, C0Array(C0Instr *) *order, C0Array(C0Instr *) array);
+
+static void c0_compact_emit_instr(C0CompactProc *c, C0InstrMap *refs, C0Array(C0Instr *) *order, C0Instr *instr) {
+	C0Ref ref = c0_compact_emit(c, refs, order, instr);
+	if (!c0_compact_is_block(instr->kind)) {
+		return;
+	}
+	c0_compact_emit_block(c, refs, order, instr->nested_instrs);
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_compact_emit_instr(c, refs, order, instr->args[1]);
+	}
+	c->instrs[ref].args[2] = (C0Ref)c0array_len(c->instrs);
+}
+
+static void c0_compact_emit_block(C0CompactProc *c, C0InstrMap *refs, C0Array(C0Instr *) *order, C0Array(C0Instr *) array) {
+	for (isize i = 0; i < c0array_len(array); i++) {
+		c0_compact_emit_instr(c, refs, order, array[i]);
+	}
+}
+
+void c0_compact_from_proc(C0CompactProc *c, C0Proc *p) {
+	C0_ASSERT(c0array_len(p->nested_blocks) == 0);
+	memset(c, 0, sizeof(*c));
+	c->name        = p->name;
+	c->sig         = p->sig;
+	c->finished    = p->finished;
+	c->instr_count = p->instr_count;
+
+	C0InstrMap refs = {0};
+	C0Array(C0Instr *) order = NULL;
+
+	// reference 0 and cold entry 0 are never used
+	C0CompactInstr null_instr = {0};
+	C0CompactCold  null_cold  = {0};
+	c0array_push(c->instrs, null_instr);
+	c0array_push(c->flags, 0);
+	c0array_push(c->uses, 0);
+	c0array_push(c->cold, 0);
+	c0array_push(c->colds, null_cold);
+	c0array_push(order, NULL);
+
+	c->param_count = (u32)c0array_len(p->parameters);
+	for (isize i = 0; i < c0array_len(p->parameters); i++) {
+		c0_compact_emit(c, &refs, &order, p->parameters[i]);
+	}
+	c0_compact_emit_block(c, &refs, &order, p->instrs);
+
+	for (isize ref = 1; ref < c0array_len(order); ref++) {
+		C0Instr *instr = order[ref];
+		C0CompactInstr *hot = &c->instrs[ref];
+		if (instr->args_len > C0_INLINE_ARGS) {
+			hot->args_len = C0_COMPACT_SPILLED;
+			hot->args[0]  = (C0Ref)c0array_len(c->extra_args);
+			hot->args[1]  = (C0Ref)instr->args_len;
+			for (isize i = 0; i < instr->args_len; i++) {
+				c0array_push(c->extra_args, c0_compact_ref(&refs, instr->args[i]));
+			}
+		} else {
+			hot->args_len = (u8)instr->args_len;
+			for (isize i = 0; i < instr->args_len; i++) {
+				hot->args[i] = c0_compact_ref(&refs, instr->args[i]);
+			}
+		}
+	}
+
+	c0array_free(order);
+	c0_instr_map_destroy(&refs);
+}
+
+static void c0_compact_build_block(C0CompactProc *c, C0Proc *p, C0Instr **made, C0Ref block);
+
+static void c0_compact_build_body(C0CompactProc *c, C0Proc *p, C0Instr **made, C0Array(C0Instr *) *out, C0Ref start, C0Ref end) {
+	for (C0Ref ref = start; ref < end; ref = c0_compact_next(c, ref)) {
+		c0_instrs_push(p, out, made[ref]);
+		if (c0_compact_is_block(c->instrs[ref].kind)) {
+			c0_compact_build_block(c, p, made, ref);
+		}
+		if (c->instrs[ref].kind == C0Instr_label) {
+			c0array_push(p->labels, made[ref]);
+		}
+	}
+}
+
+static void c0_compact_build_block(C0CompactProc *c, C0Proc *p, C0Instr **made, C0Ref block) {
+	c0_compact_build_body(c, p, made, &made[block]->nested_instrs, block+1, c0_compact_body_end(c, block));
+	C0CompactInstr *instr = &c->instrs[block];
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_compact_build_block(c, p, made, instr->args[1]);
+	}
+}
+
+void c0_compact_to_proc(C0CompactProc *c, C0Proc *p) {
+	C0_ASSERT(c0array_len(p->nested_blocks) == 0);
+	C0_ASSERT(c0array_len(p->parameters) == c->param_count);
+
+	u32 count = (u32)c0array_len(c->instrs);
+	C0Instr **made = (C0Instr **)c0_heap_calloc(sizeof(C0Instr *), count);
+	for (u32 ref = 1; ref < count; ref++) {
+		C0CompactInstr *hot = &c->instrs[ref];
+		C0Instr *instr = NULL;
+		if (ref <= c->param_count) {
+			instr = p->parameters[ref-1];
+		} else {
+			instr = c0_instr_create(p, hot->kind);
+			isize args_len = hot->args_len == C0_COMPACT_SPILLED ? hot->args[1] : hot->args_len;
+			if (hot->kind == C0Instr_if) {
+				c0_alloc_args(p, instr, 2); // room for an else
+				instr->args_len = args_len;
+			} else {
+				c0_alloc_args(p, instr, args_len);
+			}
+		}
+		instr->basic_type = hot->basic_type;
+		instr->flags = c->flags[ref];
+		instr->uses  = c->uses[ref];
+
+		C0CompactCold *cold = &c->colds[c->cold[ref]];
+		instr->name      = cold->name;
+		instr->agg_type  = cold->agg_type;
+		instr->call_proc = cold->call_proc;
+		instr->call_sig  = cold->call_sig;
+		instr->alignment = cold->alignment;
+		instr->value_u64 = cold->value;
+		made[ref] = instr;
+	}
+
+	for (u32 ref = c->param_count+1; ref < count; ref++) {
+		isize args_len = 0;
+		C0Ref *args = c0_compact_args(c, ref, &args_len);
+		for (isize i = 0; i < args_len; i++) {
+			made[ref]->args[i] = made[args[i]];
+		}
+	}
+
+	c0array_free(p->labels);
+	c0array_free(p->instrs);
+	c0_compact_build_body(c, p, made, &p->instrs, c->param_count+1, count);
+	c0_heap_free(made);
+
+	if (c->finished) {
+		// the walk is the same as in `c0_proc_finish` so the same ids come out
+		u32 reg_id = 0;
+		for (isize i = 0; i < c0array_len(p->instrs); i++) {
+			c0_assign_reg_id(p->instrs[i], &reg_id);
+		}
+	}
+	p->finished    = c->finished;
+	p->instr_count = c->instr_count;
+}
+
+void c0_compact_destroy(C0CompactProc *c) {
+	c0array_free(c->instrs);
+	c0array_free(c->flags);
+	c0array_free(c->uses);
+	c0array_free(c->cold);
+	c0array_free(c->colds);
+	c0array_free(c->extra_args);
+}
@@ -0,0 +1,1284 @@
+#include <math.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Constant folding
+//
+// The evaluation mirrors the helpers emitted by `c0_gen_instructions_print`
+// exactly, including the masking of results and the C-like vs Odin-like shifts.
+// i128, u128 and f16 are not folded.
+///////////////////////////////////////////////////////////////////////////////
+
+static u64 c0_fold_mask(i32 bytes) {
+	return bytes >= 8 ? ~(u64)0 : ((u64)1 << (8*bytes)) - 1;
+}
+
+static i64 c0_fold_sext(u64 bits, i32 bytes) {
+	u32 shift = 64 - 8*bytes;
+	return (i64)(bits << shift) >> shift;
+}
+
+static bool c0_fold_type_ok(C0BasicType type) {
+	switch (type) {
+	case C0Basic_i8:
+	case C0Basic_u8:
+	case C0Basic_i16:
+	case C0Basic_u16:
+	case C0Basic_i32:
+	case C0Basic_u32:
+	case C0Basic_i64:
+	case C0Basic_u64:
+	case C0Basic_f32:
+	case C0Basic_f64:
+		return true;
+	}
+	return false;
+}
+
+static f32 c0_fold_get_f32(C0Instr *c) { return c->value_f32; }
+static f64 c0_fold_get_f64(C0Instr *c) { return c->value_f64; }
+
+// raw bits of a constant in its own type
+static u64 c0_fold_get_bits(C0Instr *c) {
+	switch (c->basic_type) {
+	case C0Basic_f32:
+		{
+			u32 bits = 0;
+			memcpy(&bits, &c->value_f32, sizeof(bits));
+			return bits;
+		}
+	case C0Basic_f64:
+		return c->value_u64;
+	}
+	return c->value_u64 & c0_fold_mask(c0_basic_type_sizes[c->basic_type]);
+}
+
+static void c0_fold_set_bits(C0Instr *res, C0BasicType type, u64 bits) {
+	i32 bytes = c0_basic_type_sizes[type];
+	bits &= c0_fold_mask(bytes);
+	switch (type) {
+	case C0Basic_f32:
+		{
+			u32 bits32 = (u32)bits;
+			res->value_u64 = 0;
+			memcpy(&res->value_f32, &bits32, sizeof(bits32));
+		}
+		return;
+	case C0Basic_f64:
+		res->value_u64 = bits;
+		return;
+	}
+	if (c0_basic_is_signed[type]) {
+		res->value_i64 = c0_fold_sext(bits, bytes);
+	} else {
+		res->value_u64 = bits;
+	}
+}
+
+static void c0_fold_set_f32(C0Instr *res, f32 value) {
+	res->value_u64 = 0;
+	res->value_f32 = value;
+}
+static void c0_fold_set_f64(C0Instr *res, f64 value) {
+	res->value_f64 = value;
+}
+
+static u32 c0_fold_clz(u64 x, i32 bits) {
+	u32 n = 0;
+	for (i32 i = bits-1; i >= 0 && ((x >> i) & 1) == 0; i--) {
+		n++;
+	}
+	return n;
+}
+static u32 c0_fold_ctz(u64 x, i32 bits) {
+	u32 n = 0;
+	for (i32 i = 0; i < bits && ((x >> i) & 1) == 0; i++) {
+		n++;
+	}
+	return n;
+}
+static u32 c0_fold_popcnt(u64 x) {
+	u32 n = 0;
+	for (; x; x &= x-1) {
+		n++;
+	}
+	return n;
+}
+
+#define C0_KIND_IN(kind, first, last) (C0Instr_##first <= (kind) && (kind) <= C0Instr_##last)
+
+static bool c0_fold_eval_int(C0InstrKind kind, C0BasicType res_type, C0Instr **args, isize args_len, C0Instr *res) {
+	C0BasicType t = c0_instr_arg_type[kind];
+	i32 bytes = c0_basic_type_sizes[t];
+	i32 bits  = 8*bytes;
+	bool is_signed = c0_basic_is_signed[t];
+	u64 mask = c0_fold_mask(bytes);
+	u64 shift_mask = (u64)(bits-1);
+
+	// operands are implicitly converted to the parameter type of the helper
+	u64 au = args[0]->value_u64 & mask;
+	i64 as = c0_fold_sext(au, bytes);
+	u64 bu = 0;
+	i64 bs = 0;
+	if (args_len == 2) {
+		bu = args[1]->value_u64 & mask;
+		bs = c0_fold_sext(bu, bytes);
+	}
+
+	u64 r = 0;
+	if (C0_KIND_IN(kind, clz_u8, clz_u128)) {
+		r = c0_fold_clz(au, bits);
+	} else if (C0_KIND_IN(kind, ctz_u8, ctz_u128)) {
+		r = c0_fold_ctz(au, bits);
+	} else if (C0_KIND_IN(kind, popcnt_u8, popcnt_u128)) {
+		r = c0_fold_popcnt(au);
+	} else if (C0_KIND_IN(kind, abs_i8, abs_i128)) {
+		r = as < 0 ? -(u64)as : (u64)as;
+	} else if (C0_KIND_IN(kind, add_u8, add_u128)) {
+		r = au + bu;
+	} else if (C0_KIND_IN(kind, sub_u8, sub_u128)) {
+		r = au - bu;
+	} else if (C0_KIND_IN(kind, mul_u8, mul_u128)) {
+		r = au * bu;
+	} else if (C0_KIND_IN(kind, quo_i8, quo_u128)) {
+		if (bu == 0) {
+			return false;
+		}
+		if (is_signed) {
+			if (as == INT64_MIN && bs == -1) {
+				return false;
+			}
+			r = (u64)(as / bs);
+		} else {
+			r = au / bu;
+		}
+	} else if (C0_KIND_IN(kind, rem_i8, rem_u128)) {
+		if (bu == 0) {
+			return false;
+		}
+		if (is_signed) {
+			if (as == INT64_MIN && bs == -1) {
+				return false;
+			}
+			r = (u64)(as % bs);
+		} else {
+			r = au % bu;
+		}
+	} else if (C0_KIND_IN(kind, shlc_i8, shlc_u128)) {
+		u64 s = bu & shift_mask;
+		r = is_signed ? (u64)as << s : au << s;
+	} else if (C0_KIND_IN(kind, shrc_i8, shrc_u128)) {
+		u64 s = bu & shift_mask;
+		r = is_signed ? (u64)(as >> s) : au >> s;
+	} else if (C0_KIND_IN(kind, shlo_i8, shlo_u128)) {
+		bool in_range = is_signed ? bs < bits : bu < (u64)bits;
+		i64 a = is_signed ? as : (i64)au;
+		r = in_range ? (u64)a << (bu & shift_mask) : 0;
+	} else if (C0_KIND_IN(kind, shro_i8, shro_u128)) {
+		bool in_range = is_signed ? bs < bits : bu < (u64)bits;
+		i64 a = is_signed ? as : (i64)au;
+		r = in_range ? (u64)(a >> (bu & shift_mask)) : 0;
+	} else if (C0_KIND_IN(kind, and_u8, and_u128)) {
+		r = au & bu;
+	} else if (C0_KIND_IN(kind, or_u8, or_u128)) {
+		r = au | bu;
+	} else if (C0_KIND_IN(kind, xor_u8, xor_u128)) {
+		r = au ^ bu;
+	} else if (C0_KIND_IN(kind, eq_u8, eq_u128)) {
+		r = au == bu;
+	} else if (C0_KIND_IN(kind, neq_u8, neq_u128)) {
+		r = au != bu;
+	} else if (C0_KIND_IN(kind, lt_i8, lt_u128)) {
+		r = is_signed ? as < bs : au < bu;
+	} else if (C0_KIND_IN(kind, gt_i8, gt_u128)) {
+		r = is_signed ? as > bs : au > bu;
+	} else if (C0_KIND_IN(kind, lteq_i8, lteq_u128)) {
+		r = is_signed ? as <= bs : au <= bu;
+	} else if (C0_KIND_IN(kind, gteq_i8, gteq_u128)) {
+		r = is_signed ? as >= bs : au >= bu;
+	} else if (C0_KIND_IN(kind, min_i8, min_u128)) {
+		r = (is_signed ? as < bs : au < bu) ? au : bu;
+	} else if (C0_KIND_IN(kind, max_i8, max_u128)) {
+		r = (is_signed ? as > bs : au > bu) ? au : bu;
+	} else {
+		return false;
+	}
+
+	// `(ret)(x & mask)` and then stored into a value of `res_type`
+	r &= c0_fold_mask(c0_basic_type_sizes[c0_instr_ret_type[kind]]);
+	c0_fold_set_bits(res, res_type, r);
+	return true;
+}
+
+static bool c0_fold_eval_float(C0InstrKind kind, C0BasicType res_type, C0Instr **args, isize args_len, C0Instr *res) {
+	C0BasicType t = c0_instr_arg_type[kind];
+	f64 a = t == C0Basic_f32 ? (f64)c0_fold_get_f32(args[0]) : c0_fold_get_f64(args[0]);
+	f64 b = 0;
+	if (args_len == 2) {
+		b = t == C0Basic_f32 ? (f64)c0_fold_get_f32(args[1]) : c0_fold_get_f64(args[1]);
+	}
+
+	if (C0_KIND_IN(kind, eqf_f16, gteqf_f64)) {
+		bool r = false;
+		if      (C0_KIND_IN(kind, eqf_f16,   eqf_f64))   { r = a == b; }
+		else if (C0_KIND_IN(kind, neqf_f16,  neqf_f64))  { r = a != b; }
+		else if (C0_KIND_IN(kind, ltf_f16,   ltf_f64))   { r = a <  b; }
+		else if (C0_KIND_IN(kind, gtf_f16,   gtf_f64))   { r = a >  b; }
+		else if (C0_KIND_IN(kind, lteqf_f16, lteqf_f64)) { r = a <= b; }
+		else if (C0_KIND_IN(kind, gteqf_f16, gteqf_f64)) { r = a >= b; }
+		c0_fold_set_bits(res, res_type, r);
+		return true;
+	}
+
+	if (t == C0Basic_f32) {
+		// evaluate in single precision to match the emitted C
+		f32 fa = (f32)a;
+		f32 fb = (f32)b;
+		f32 r = 0;
+		if      (C0_KIND_IN(kind, addf_f16,     addf_f64))     { r = fa + fb; }
+		else if (C0_KIND_IN(kind, subf_f16,     subf_f64))     { r = fa - fb; }
+		else if (C0_KIND_IN(kind, mulf_f16,     mulf_f64))     { r = fa * fb; }
+		else if (C0_KIND_IN(kind, divf_f16,     divf_f64))     { r = fa / fb; }
+		else if (C0_KIND_IN(kind, negf_f16,     negf_f64))     { r = -fa; }
+		else if (C0_KIND_IN(kind, absf_f16,     absf_f64))     { r = fabsf(fa); }
+		else if (C0_KIND_IN(kind, ceilf_f16,    ceilf_f64))    { r = ceilf(fa); }
+		else if (C0_KIND_IN(kind, floorf_f16,   floorf_f64))   { r = floorf(fa); }
+		else if (C0_KIND_IN(kind, nearestf_f16, nearestf_f64)) { r = nearbyintf(fa); }
+		else if (C0_KIND_IN(kind, truncf_f16,   truncf_f64))   { r = truncf(fa); }
+		else if (C0_KIND_IN(kind, sqrtf_f16,    sqrtf_f64))    { r = sqrtf(fa); }
+		else { return false; }
+		c0_fold_set_f32(res, r);
+	} else {
+		f64 r = 0;
+		if      (C0_KIND_IN(kind, addf_f16,     addf_f64))     { r = a + b; }
+		else if (C0_KIND_IN(kind, subf_f16,     subf_f64))     { r = a - b; }
+		else if (C0_KIND_IN(kind, mulf_f16,     mulf_f64))     { r = a * b; }
+		else if (C0_KIND_IN(kind, divf_f16,     divf_f64))     { r = a / b; }
+		else if (C0_KIND_IN(kind, negf_f16,     negf_f64))     { r = -a; }
+		else if (C0_KIND_IN(kind, absf_f16,     absf_f64))     { r = fabs(a); }
+		else if (C0_KIND_IN(kind, ceilf_f16,    ceilf_f64))    { r = ceil(a); }
+		else if (C0_KIND_IN(kind, floorf_f16,   floorf_f64))   { r = floor(a); }
+		else if (C0_KIND_IN(kind, nearestf_f16, nearestf_f64)) { r = nearbyint(a); }
+		else if (C0_KIND_IN(kind, truncf_f16,   truncf_f64))   { r = trunc(a); }
+		else if (C0_KIND_IN(kind, sqrtf_f16,    sqrtf_f64))    { r = sqrt(a); }
+		else { return false; }
+		c0_fold_set_f64(res, r);
+	}
+	return true;
+}
+
+static bool c0_fold_eval_convert(C0BasicType from, C0BasicType to, C0Instr *arg, C0Instr *res) {
+	bool from_float = c0_basic_type_is_float(from);
+	bool to_float   = c0_basic_type_is_float(to);
+	i32 from_bytes = c0_basic_type_sizes[from];
+
+	if (!from_float && !to_float) {
+		// `(to)a`, widening a signed value sign extends it
+		u64 bits = arg->value_u64 & c0_fold_mask(from_bytes);
+		if (c0_basic_is_signed[from]) {
+			bits = (u64)c0_fold_sext(bits, from_bytes);
+		}
+		c0_fold_set_bits(res, to, bits);
+		return true;
+	}
+
+	if (!from_float) {
+		u64 au = arg->value_u64 & c0_fold_mask(from_bytes);
+		if (c0_basic_is_signed[from]) {
+			i64 as = c0_fold_sext(au, from_bytes);
+			if (to == C0Basic_f32) { c0_fold_set_f32(res, (f32)as); } else { c0_fold_set_f64(res, (f64)as); }
+		} else {
+			if (to == C0Basic_f32) { c0_fold_set_f32(res, (f32)au); } else { c0_fold_set_f64(res, (f64)au); }
+		}
+		return true;
+	}
+
+	f64 a = from == C0Basic_f32 ? (f64)c0_fold_get_f32(arg) : c0_fold_get_f64(arg);
+	if (to_float) {
+		if (to == C0Basic_f32) {
+			c0_fold_set_f32(res, (f32)a);
+		} else {
+			c0_fold_set_f64(res, a);
+		}
+		return true;
+	}
+
+	// float to integer, only when well-defined in C
+	if (a != a) {
+		return false;
+	}
+	f64 t = trunc(a);
+	i32 to_bytes = c0_basic_type_sizes[to];
+	if (c0_basic_is_signed[to]) {
+		f64 lo = -ldexp(1.0, 8*to_bytes-1);
+		f64 hi =  ldexp(1.0, 8*to_bytes-1);
+		if (!(lo <= t && t < hi)) {
+			return false;
+		}
+		c0_fold_set_bits(res, to, (u64)(i64)t);
+	} else {
+		f64 hi = ldexp(1.0, 8*to_bytes);
+		if (!(0 <= t && t < hi)) {
+			return false;
+		}
+		c0_fold_set_bits(res, to, (u64)t);
+	}
+	return true;
+}
+
+static bool c0_instr_is_constant(C0Instr *instr) {
+	return instr && (instr->flags & C0InstrFlag_constant) != 0;
+}
+
+// Evaluates `instr` if all of its arguments are constants, writing the value into `res`
+static bool c0_fold_eval(C0Instr *instr, C0Instr *res) {
+	C0InstrKind kind = instr->kind;
+	if (instr->agg_type != NULL || instr->args_len == 0 || instr->args_len > 3) {
+		return false;
+	}
+	for (isize i = 0; i < instr->args_len; i++) {
+		C0Instr *arg = instr->args[i];
+		if (!c0_instr_is_constant(arg) || !c0_fold_type_ok(arg->basic_type)) {
+			return false;
+		}
+	}
+	if (!c0_fold_type_ok(instr->basic_type)) {
+		return false;
+	}
+
+	switch (kind) {
+	case C0Instr_convert:
+		return c0_fold_eval_convert(instr->args[0]->basic_type, instr->basic_type, instr->args[0], res);
+	case C0Instr_reinterpret:
+		if (c0_basic_type_sizes[instr->args[0]->basic_type] != c0_basic_type_sizes[instr->basic_type]) {
+			return false;
+		}
+		c0_fold_set_bits(res, instr->basic_type, c0_fold_get_bits(instr->args[0]));
+		return true;
+	}
+
+	if (C0_KIND_IN(kind, select_u8, select_ptr)) {
+		C0Instr *chosen = (instr->args[0]->value_u64 & c0_fold_mask(c0_basic_type_sizes[instr->args[0]->basic_type])) ? instr->args[1] : instr->args[2];
+		c0_fold_set_bits(res, instr->basic_type, c0_fold_get_bits(chosen));
+		return true;
+	}
+
+	C0BasicType t = c0_instr_arg_type[kind];
+	if (c0_instr_arg_count[kind] != instr->args_len || !c0_fold_type_ok(t)) {
+		return false;
+	}
+	if (C0_KIND_IN(kind, clz_u8, max_u128)) {
+		return c0_fold_eval_int(kind, instr->basic_type, instr->args, instr->args_len, res);
+	}
+	if (C0_KIND_IN(kind, negf_f16, sqrtf_f64) || C0_KIND_IN(kind, addf_f16, gteqf_f64)) {
+		return c0_fold_eval_float(kind, instr->basic_type, instr->args, instr->args_len, res);
+	}
+	return false;
+}
+
+// Replaces `instr` in place with a constant if it can be evaluated, releasing its arguments
+static bool c0_fold_instr(C0Instr *instr) {
+	if (instr->kind == C0Instr_decl) {
+		return false;
+	}
+	C0Instr value = {0};
+	if (!c0_fold_eval(instr, &value)) {
+		return false;
+	}
+	for (isize i = 0; i < instr->args_len; i++) {
+		c0_unuse(instr->args[i]);
+	}
+	instr->kind      = C0Instr_decl;
+	instr->args      = NULL;
+	instr->args_len  = 0;
+	instr->flags    |= C0InstrFlag_constant;
+	instr->value_u64 = value.value_u64;
+	return true;
+}
+
+static void c0_fold_constants_instr(C0Instr *instr) {
+	c0_fold_instr(instr);
+	isize len = c0array_len(instr->nested_instrs);
+	for (isize i = 0; i < len; i++) {
+		c0_fold_constants_instr(instr->nested_instrs[i]);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_fold_constants_instr(instr->args[1]);
+	}
+}
+
+void c0_pass_fold_constants(C0Array(C0Instr *) array) {
+	isize len = c0array_len(array);
+	for (isize i = 0; i < len; i++) {
+		c0_fold_constants_instr(array[i]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Instruction maps
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct C0InstrMapEntry {
+	C0Instr *key;
+	C0Instr *value;
+} C0InstrMapEntry;
+
+// Open addressed map from one instruction to another, keyed by pointer
+typedef struct C0InstrMap {
+	C0InstrMapEntry *entries;
+	usize            len;
+	usize            cap;
+} C0InstrMap;
+
+static usize c0_instr_map_index(C0InstrMap *m, C0Instr *key) {
+	usize mask = m->cap-1;
+	usize i = (usize)c0_hash_u64(0, (u64)(uintptr_t)key) & mask;
+	while (m->entries[i].key != NULL && m->entries[i].key != key) {
+		i = (i+1) & mask;
+	}
+	return i;
+}
+
+static C0Instr *c0_instr_map_get(C0InstrMap *m, C0Instr *key) {
+	if (m->len == 0) {
+		return NULL;
+	}
+	return m->entries[c0_instr_map_index(m, key)].value;
+}
+
+static void c0_instr_map_set(C0InstrMap *m, C0Instr *key, C0Instr *value) {
+	if (2*(m->len+1) > m->cap) {
+		usize old_cap = m->cap;
+		C0InstrMapEntry *old_entries = m->entries;
+		m->cap = old_cap ? 2*old_cap : 256;
+		m->entries = (C0InstrMapEntry *)c0_heap_calloc(sizeof(C0InstrMapEntry), m->cap);
+		for (usize j = 0; j < old_cap; j++) {
+			if (old_entries[j].key != NULL) {
+				m->entries[c0_instr_map_index(m, old_entries[j].key)] = old_entries[j];
+			}
+		}
+		c0_heap_free(old_entries);
+	}
+	usize i = c0_instr_map_index(m, key);
+	if (m->entries[i].key == NULL) {
+		m->entries[i].key = key;
+		m->len += 1;
+	}
+	m->entries[i].value = value;
+}
+
+static void c0_instr_map_clear(C0InstrMap *m) {
+	if (m->len != 0) {
+		memset(m->entries, 0, sizeof(C0InstrMapEntry)*m->cap);
+		m->len = 0;
+	}
+}
+
+static void c0_instr_map_destroy(C0InstrMap *m) {
+	c0_heap_free(m->entries);
+	m->entries = NULL;
+	m->len = 0;
+	m->cap = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Value numbering
+//
+// A pure instruction identical to one already computed in a dominating scope is
+// replaced by that earlier value and its users are rewritten; the duplicate is left
+// with no uses for `c0_pass_remove_unused_instructions` to clean up.
+//
+// Loads, and anything reading a decl whose address has been taken, are also keyed by
+// a memory epoch which is bumped by anything which may write to memory (and on entry
+// to a loop). A label bumps the generation which invalidates every value before it.
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct C0ValueEntry {
+	C0Instr *instr;
+	u64      hash;
+	u32      epoch;
+	u32      generation;
+} C0ValueEntry;
+
+typedef struct C0ValueNumbering {
+	// open addressed, always holds exactly the entries of `stack`
+	C0ValueEntry *table;
+	usize         table_cap;
+	// in insertion order, which is what allows entries to be removed when leaving a scope
+	C0Array(C0ValueEntry) stack;
+
+	C0InstrMap replacements;
+
+	u32 epoch;
+	u32 generation;
+} C0ValueNumbering;
+
+static bool c0_value_is_pure(C0Instr *instr) {
+	if (instr->name.len != 0 || instr->alignment != 0) {
+		return false;
+	}
+	switch (instr->kind) {
+	case C0Instr_decl:
+		return false;
+	case C0Instr_convert:
+	case C0Instr_reinterpret:
+	case C0Instr_addr:
+	case C0Instr_index_ptr:
+	case C0Instr_field_ptr:
+		return true;
+	}
+	return C0_KIND_IN(instr->kind, load_u8, load_ptr) ||
+	       C0_KIND_IN(instr->kind, clz_u8, gteqf_f64) ||
+	       C0_KIND_IN(instr->kind, select_u8, select_ptr);
+}
+
+static bool c0_value_reads_memory(C0Instr *instr) {
+	if (C0_KIND_IN(instr->kind, load_u8, load_ptr)) {
+		return true;
+	}
+	for (isize i = 0; i < instr->args_len; i++) {
+		C0Instr *arg = instr->args[i];
+		if (arg->kind == C0Instr_decl && (arg->flags & C0InstrFlag_addr_taken)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool c0_value_writes_memory(C0Instr *instr) {
+	switch (instr->kind) {
+	case C0Instr_memmove:
+	case C0Instr_memset:
+	case C0Instr_call:
+		return true;
+	}
+	return C0_KIND_IN(instr->kind, store_u8, store_ptr) ||
+	       C0_KIND_IN(instr->kind, atomic_thread_fence, atomic_xor_u64);
+}
+
+static u64 c0_value_hash(C0Instr *instr, u32 epoch) {
+	u64 h = 0xcbf29ce484222325ull;
+	h = c0_hash_u64(h, ((u64)instr->kind << 32) | ((u64)instr->basic_type << 16));
+	h = c0_hash_u64(h, (u64)(uintptr_t)instr->agg_type);
+	h = c0_hash_u64(h, instr->value_u64);
+	h = c0_hash_u64(h, epoch);
+	for (isize i = 0; i < instr->args_len; i++) {
+		h = c0_hash_u64(h, (u64)(uintptr_t)instr->args[i]);
+	}
+	return h;
+}
+
+static bool c0_value_equal(C0Instr *a, C0Instr *b) {
+	if (a->kind       != b->kind       ||
+	    a->basic_type != b->basic_type ||
+	    a->agg_type   != b->agg_type   ||
+	    a->value_u64  != b->value_u64  ||
+	    a->args_len   != b->args_len) {
+		return false;
+	}
+	for (isize i = 0; i < a->args_len; i++) {
+		if (a->args[i] != b->args[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void c0_value_table_place(C0ValueNumbering *vn, C0ValueEntry entry) {
+	usize mask = vn->table_cap-1;
+	usize i = (usize)entry.hash & mask;
+	while (vn->table[i].instr != NULL) {
+		i = (i+1) & mask;
+	}
+	vn->table[i] = entry;
+}
+
+static C0Instr *c0_value_find(C0ValueNumbering *vn, C0Instr *instr, u64 hash, u32 epoch) {
+	if (vn->table_cap == 0) {
+		return NULL;
+	}
+	usize mask = vn->table_cap-1;
+	for (usize i = (usize)hash & mask; vn->table[i].instr != NULL; i = (i+1) & mask) {
+		C0ValueEntry *e = &vn->table[i];
+		if (e->hash == hash && e->epoch == epoch && e->generation == vn->generation && c0_value_equal(e->instr, instr)) {
+			return e->instr;
+		}
+	}
+	return NULL;
+}
+
+static void c0_value_insert(C0ValueNumbering *vn, C0Instr *instr, u64 hash, u32 epoch) {
+	C0ValueEntry entry = {instr, hash, epoch, vn->generation};
+	c0array_push(vn->stack, entry);
+
+	isize len = c0array_len(vn->stack);
+	if (2*(usize)len > vn->table_cap) {
+		c0_heap_free(vn->table);
+		vn->table_cap = vn->table_cap ? 2*vn->table_cap : 256;
+		vn->table = (C0ValueEntry *)c0_heap_calloc(sizeof(C0ValueEntry), vn->table_cap);
+		for (isize i = 0; i < len; i++) {
+			c0_value_table_place(vn, vn->stack[i]);
+		}
+	} else {
+		c0_value_table_place(vn, entry);
+	}
+}
+
+// Removes every entry inserted since the stack held `len` entries
+// with linear probing, removing the most recent insertion restores the
+// table to exactly its previous state, so no tombstones are needed
+static void c0_value_pop(C0ValueNumbering *vn, isize len) {
+	usize mask = vn->table_cap-1;
+	while (c0array_len(vn->stack) > len) {
+		C0ValueEntry entry = c0array_last(vn->stack);
+		c0array_pop(vn->stack);
+		usize i = (usize)entry.hash & mask;
+		while (vn->table[i].instr != entry.instr) {
+			i = (i+1) & mask;
+		}
+		vn->table[i].instr = NULL;
+	}
+}
+
+static void c0_value_numbering_block(C0ValueNumbering *vn, C0Array(C0Instr *) array);
+
+static void c0_value_numbering_instr(C0ValueNumbering *vn, C0Instr *instr) {
+	isize args_len = instr->args_len;
+	if (instr->kind == C0Instr_if) {
+		args_len = 1; // only the condition, the else block is handled below
+	}
+	for (isize i = 0; i < args_len; i++) {
+		C0Instr *to = c0_instr_map_get(&vn->replacements, instr->args[i]);
+		if (to != NULL) {
+			c0_unuse(instr->args[i]);
+			instr->args[i] = c0_use(to);
+		}
+	}
+
+	if (instr->kind == C0Instr_label) {
+		vn->generation += 1;
+	} else if (c0_value_writes_memory(instr)) {
+		vn->epoch += 1;
+	} else if (c0_value_is_pure(instr)) {
+		u32 epoch = c0_value_reads_memory(instr) ? vn->epoch : 0;
+		u64 hash = c0_value_hash(instr, epoch);
+		C0Instr *existing = c0_value_find(vn, instr, hash, epoch);
+		if (existing != NULL) {
+			c0_instr_map_set(&vn->replacements, instr, existing);
+		} else {
+			c0_value_insert(vn, instr, hash, epoch);
+		}
+		return;
+	}
+
+	if (instr->nested_instrs != NULL) {
+		if (instr->kind == C0Instr_loop) {
+			vn->epoch += 1; // the body may be reached again after any of its own writes
+		}
+		isize len = c0array_len(vn->stack);
+		c0_value_numbering_block(vn, instr->nested_instrs);
+		c0_value_pop(vn, len);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		isize len = c0array_len(vn->stack);
+		c0_value_numbering_instr(vn, instr->args[1]);
+		c0_value_pop(vn, len);
+	}
+}
+
+static void c0_value_numbering_block(C0ValueNumbering *vn, C0Array(C0Instr *) array) {
+	isize len = c0array_len(array);
+	for (isize i = 0; i < len; i++) {
+		c0_value_numbering_instr(vn, array[i]);
+	}
+}
+
+void c0_pass_value_numbering(C0Array(C0Instr *) array) {
+	C0ValueNumbering vn = {0};
+	c0_value_numbering_block(&vn, array);
+	c0_heap_free(vn.table);
+	c0_instr_map_destroy(&vn.replacements);
+	c0array_free(vn.stack);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inlining
+//
+// Calls to finished procedures are replaced with a copy of the callee's body.
+// Recursive calls and `C0ProcFlag_never_inline` procedures are never inlined,
+// `C0ProcFlag_always_inline` ones always are, and anything else must have no more
+// than `C0Gen.inline_threshold` instructions.
+//
+// A callee whose only `return` is its last instruction is spliced straight into the
+// caller. Otherwise it is copied into a block in which each `return` becomes a store
+// to a result decl followed by a `goto` to a label just after the block.
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct C0Inliner {
+	C0Proc *   p;
+	C0InstrMap replacements; // inlined call -> its result
+
+	// for the call currently being inlined
+	C0InstrMap clones; // callee instruction -> its copy in the caller
+	C0Instr *  last;   // the callee's last instruction, which needs no jump
+	C0Instr *  result; // decl which each `return` stores to
+	C0Instr *  end;    // label which each `return` jumps to, NULL when spliced
+	C0Instr *  value;  // what the call is replaced with
+} C0Inliner;
+
+static bool c0_inline_should_inline(C0Proc *p, C0Instr *call) {
+	C0Proc *callee = call->call_proc;
+	if (callee == NULL || callee == p || !callee->finished) {
+		return false;
+	}
+	C0ProcFlags flags = callee->sig->proc.flags;
+	if (flags & (C0ProcFlag_never_inline|C0ProcFlag_variadic)) {
+		return false;
+	}
+	if (callee->sig->proc.ret->kind != C0AggType_basic) {
+		return false;
+	}
+	for (isize i = 0; i < c0array_len(callee->parameters); i++) {
+		if (callee->parameters[i]->agg_type != NULL) {
+			return false; // arguments are copied with basic stores
+		}
+	}
+	if (flags & C0ProcFlag_always_inline) {
+		return true;
+	}
+	return p->gen->inline_threshold > 0 && callee->instr_count <= p->gen->inline_threshold;
+}
+
+static isize c0_inline_count_returns(C0Instr *instr) {
+	isize count = instr->kind == C0Instr_return;
+	for (isize i = 0; i < c0array_len(instr->nested_instrs); i++) {
+		count += c0_inline_count_returns(instr->nested_instrs[i]);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		count += c0_inline_count_returns(instr->args[1]);
+	}
+	return count;
+}
+
+static C0Instr *c0_inline_create_label(C0Proc *p) {
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "_C0_inline_%u", (unsigned)c0array_len(p->labels));
+	C0String name = {buf, len};
+
+	C0Instr *label = c0_instr_create(p, C0Instr_label);
+	label->name = c0_intern(p->gen, name);
+	c0array_push(p->labels, label);
+	return label;
+}
+
+static void c0_inline_push_store(C0Proc *p, C0Array(C0Instr *) *out, C0Instr *decl, C0Instr *value) {
+	C0Instr *addr = c0_instr_create(p, C0Instr_addr);
+	c0_alloc_args(p, addr, 1);
+	addr->args[0] = c0_use(decl);
+
+	C0Instr *store = c0_instr_create(p, c0_instr_store_kind(value->basic_type));
+	store->basic_type = C0Basic_void;
+	c0_alloc_args(p, store, 2);
+	store->args[0] = c0_use(addr);
+	store->args[1] = c0_use(value);
+	c0_use(store);
+
+	c0_instrs_push(p, out, addr);
+	c0_instrs_push(p, out, store);
+}
+
+static C0Instr *c0_inline_clone_arg(C0Inliner *in, C0Instr *arg) {
+	C0Instr *clone = c0_instr_map_get(&in->clones, arg);
+	C0_ASSERT(clone != NULL);
+	return c0_use(clone);
+}
+
+static void c0_inline_clone_block(C0Inliner *in, C0Array(C0Instr *) *out, C0Array(C0Instr *) array);
+
+static C0Instr *c0_inline_clone_instr(C0Inliner *in, C0Instr *instr) {
+	C0Proc *p = in->p;
+	if (instr->kind == C0Instr_label) {
+		return c0_instr_map_get(&in->clones, instr);
+	}
+
+	C0Instr *clone = c0_instr_create(p, instr->kind);
+	*clone = *instr;
+	clone->flags &= ~C0InstrFlag_print_inline;
+	clone->args = NULL;
+	clone->nested_instrs = NULL;
+	if (clone->basic_type != C0Basic_void || clone->agg_type != NULL) {
+		clone->uses = 0; // counted as the users are cloned
+	}
+	if (clone->kind == C0Instr_decl) {
+		clone->name.text = NULL;
+		clone->name.len  = 0;
+	}
+
+	if (instr->args_len != 0) {
+		isize args_len = instr->args_len;
+		if (instr->kind == C0Instr_if) {
+			c0_alloc_args(p, clone, 2);
+			args_len = 1;
+		} else {
+			c0_alloc_args(p, clone, args_len);
+		}
+		clone->args_len = instr->args_len;
+		for (isize i = 0; i < args_len; i++) {
+			clone->args[i] = c0_inline_clone_arg(in, instr->args[i]);
+		}
+	}
+	c0_instr_map_set(&in->clones, instr, clone);
+
+	if (instr->nested_instrs != NULL) {
+		c0_inline_clone_block(in, &clone->nested_instrs, instr->nested_instrs);
+		c0_block_update_terminating(clone);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		clone->args[1] = c0_inline_clone_instr(in, instr->args[1]);
+	}
+	return clone;
+}
+
+static void c0_inline_clone_block(C0Inliner *in, C0Array(C0Instr *) *out, C0Array(C0Instr *) array) {
+	for (isize i = 0; i < c0array_len(array); i++) {
+		C0Instr *instr = array[i];
+		if (instr->kind != C0Instr_return) {
+			c0_instrs_push(in->p, out, c0_inline_clone_instr(in, instr));
+			continue;
+		}
+
+		if (in->end == NULL) {
+			// spliced, so this is the last instruction of the callee
+			if (instr->args_len != 0) {
+				in->value = c0_instr_map_get(&in->clones, instr->args[0]);
+			}
+			continue;
+		}
+		if (instr->args_len != 0) {
+			c0_inline_push_store(in->p, out, in->result, c0_instr_map_get(&in->clones, instr->args[0]));
+		}
+		if (instr == in->last) {
+			continue;
+		}
+		C0Instr *jump = c0_instr_create(in->p, C0Instr_goto);
+		c0_alloc_args(in->p, jump, 1);
+		jump->args[0] = c0_use(in->end);
+		c0_instrs_push(in->p, out, jump);
+	}
+}
+
+static void c0_inline_call(C0Inliner *in, C0Array(C0Instr *) *out, C0Instr *call) {
+	C0Proc *p = in->p;
+	C0Proc *callee = call->call_proc;
+	C0AggType *sig = callee->sig;
+
+	c0_instr_map_clear(&in->clones);
+	in->result = NULL;
+	in->end    = NULL;
+	in->value  = NULL;
+	in->last   = NULL;
+	if (c0array_len(callee->instrs) > 0) {
+		in->last = c0array_last(callee->instrs);
+	}
+
+	// only named parameters have a decl, see `c0_proc_create`
+	isize param_index = 0;
+	for (isize i = 0; i < c0array_len(sig->proc.names); i++) {
+		if (sig->proc.names[i].len == 0) {
+			continue;
+		}
+		C0Instr *param = callee->parameters[param_index++];
+		C0Instr *arg = call->args[i];
+		if ((param->flags & C0InstrFlag_addr_taken) || !(arg->kind == C0Instr_decl && (arg->flags & C0InstrFlag_constant))) {
+			// like a real call the value is copied here, as values are printed where they are
+			// used and the callee may write to its parameter or to whatever `arg` reads
+			C0Instr *copy = c0_instr_create(p, C0Instr_decl);
+			copy->basic_type = param->basic_type;
+			copy->alignment  = param->alignment;
+			copy->flags     |= C0InstrFlag_addr_taken;
+			c0_instrs_push(in->p, out, copy);
+			c0_inline_push_store(p, out, copy, arg);
+			arg = copy;
+		}
+		c0_instr_map_set(&in->clones, param, arg);
+	}
+	for (isize i = 0; i < call->args_len; i++) {
+		c0_unuse(call->args[i]);
+	}
+	for (isize i = 0; i < c0array_len(callee->labels); i++) {
+		c0_instr_map_set(&in->clones, callee->labels[i], c0_inline_create_label(p));
+	}
+
+	bool has_result = !c0_types_agg_basic(sig->proc.ret, C0Basic_void);
+	isize returns = 0;
+	for (isize i = 0; i < c0array_len(callee->instrs); i++) {
+		returns += c0_inline_count_returns(callee->instrs[i]);
+	}
+	bool splice = false;
+	if (returns == 0) {
+		splice = !has_result;
+	} else if (returns == 1) {
+		splice = in->last->kind == C0Instr_return;
+	}
+
+	if (splice) {
+		c0_inline_clone_block(in, out, callee->instrs);
+	} else {
+		if (has_result) {
+			in->result = c0_instr_create(p, C0Instr_decl);
+			in->result->basic_type = sig->proc.ret->basic.type;
+			in->result->flags |= C0InstrFlag_addr_taken;
+			c0_instrs_push(in->p, out, in->result);
+		}
+		in->end = c0_inline_create_label(p);
+
+		C0Instr *block = c0_instr_create(p, C0Instr_block);
+		c0_use(block);
+		c0_inline_clone_block(in, &block->nested_instrs, callee->instrs);
+		c0_block_update_terminating(block);
+		c0_instrs_push(in->p, out, block);
+		if (in->end->uses != 0) {
+			c0_instrs_push(in->p, out, in->end);
+		}
+		in->value = in->result;
+	}
+
+	if (in->value != NULL) {
+		c0_instr_map_set(&in->replacements, call, in->value);
+	}
+}
+
+static void c0_inline_block(C0Inliner *in, C0Array(C0Instr *) *array);
+
+static void c0_inline_instr(C0Inliner *in, C0Instr *instr) {
+	isize args_len = instr->args_len;
+	if (instr->kind == C0Instr_if) {
+		args_len = 1; // only the condition, the else block is handled below
+	}
+	for (isize i = 0; i < args_len; i++) {
+		C0Instr *to = c0_instr_map_get(&in->replacements, instr->args[i]);
+		if (to != NULL) {
+			c0_unuse(instr->args[i]);
+			instr->args[i] = c0_use(to);
+		}
+	}
+
+	if (instr->nested_instrs != NULL) {
+		c0_inline_block(in, &instr->nested_instrs);
+		c0_block_update_terminating(instr);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_inline_instr(in, instr->args[1]);
+	}
+}
+
+static void c0_inline_block(C0Inliner *in, C0Array(C0Instr *) *array) {
+	C0Array(C0Instr *) out = NULL; // only built once something has been inlined
+	isize len = c0array_len(*array);
+	for (isize i = 0; i < len; i++) {
+		C0Instr *instr = (*array)[i];
+		c0_inline_instr(in, instr);
+		if (instr->kind == C0Instr_call && c0_inline_should_inline(in->p, instr)) {
+			if (out == NULL) {
+				for (isize j = 0; j < i; j++) {
+					c0_instrs_push(in->p, &out, (*array)[j]);
+				}
+			}
+			c0_inline_call(in, &out, instr);
+		} else if (out != NULL) {
+			c0_instrs_push(in->p, &out, instr);
+		}
+	}
+	if (out != NULL) {
+		c0array_free(*array);
+		*array = out;
+	}
+}
+
+void c0_pass_inline_calls(C0Proc *p) {
+	C0Inliner in = {0};
+	in.p = p;
+	c0_inline_block(&in, &p->instrs);
+	c0_instr_map_destroy(&in.replacements);
+	c0_instr_map_destroy(&in.clones);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tail calls
+//
+// With `C0Gen.tail_calls` set, a procedure which returns the result of calling
+// itself is wrapped in a loop, and each such call is replaced by storing its
+// arguments to the parameters and a `continue`. A call which is the operand of an
+// integer `add` or `mul` feeding the return is handled by keeping a running
+// accumulator, which every other `return` then combines with its value.
+//
+// Only the instructions between the call and the `return` are moved, so these must
+// be free of side effects, and calls within a nested loop are left alone.
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct C0TailCall {
+	C0Instr *call;
+	C0Instr *op;    // the `add` or `mul` combining the result of the call, if any
+	C0Instr *other; // the other operand of `op`
+	isize    call_index;
+} C0TailCall;
+
+typedef struct C0TailCalls {
+	C0Proc *    p;
+	C0InstrKind acc_kind; // C0Instr_invalid when there is no accumulator
+	C0BasicType acc_type;
+	C0Instr *   acc;
+	isize       count;
+} C0TailCalls;
+
+static bool c0_tail_is_self_call(C0Proc *p, C0Instr *instr) {
+	return instr->kind == C0Instr_call && instr->call_proc == p && instr->uses == 1;
+}
+
+static bool c0_tail_is_acc_op(C0Instr *instr) {
+	return instr->uses == 1 && (C0_KIND_IN(instr->kind, add_u8, add_u128) || C0_KIND_IN(instr->kind, mul_u8, mul_u128));
+}
+
+// Matches `return f(...)` or `return f(...) op x` where the `return` is `array[ret_index]`
+static bool c0_tail_match(C0Proc *p, C0Array(C0Instr *) array, isize ret_index, C0TailCall *tc) {
+	C0Instr *ret = array[ret_index];
+	memset(tc, 0, sizeof(*tc));
+	if (ret->args_len == 0) {
+		// `f(); return;`
+		isize i = ret_index-1;
+		while (i >= 0 && c0_value_is_pure(array[i]) && !c0_value_reads_memory(array[i])) {
+			i--;
+		}
+		if (i >= 0 && array[i]->kind == C0Instr_call && array[i]->call_proc == p && array[i]->uses == 0) {
+			tc->call = array[i];
+			tc->call_index = i;
+			return true;
+		}
+		return false;
+	}
+
+	C0Instr *value = ret->args[0];
+	if (c0_tail_is_self_call(p, value)) {
+		tc->call = value;
+	} else if (c0_tail_is_acc_op(value)) {
+		tc->op = value;
+	} else {
+		return false;
+	}
+
+	// everything between the call and the `return` is moved before the call
+	for (isize i = ret_index-1; i >= 0; i--) {
+		C0Instr *instr = array[i];
+		if (tc->op != NULL && tc->call == NULL && (instr == tc->op->args[0] || instr == tc->op->args[1])) {
+			if (c0_tail_is_self_call(p, instr)) {
+				tc->call  = instr;
+				tc->other = instr == tc->op->args[0] ? tc->op->args[1] : tc->op->args[0];
+			}
+		}
+		if (instr == tc->call) {
+			tc->call_index = i;
+			return true;
+		}
+		if (instr != tc->op && !(c0_value_is_pure(instr) && !c0_value_reads_memory(instr))) {
+			return false;
+		}
+	}
+	return false;
+}
+
+static bool c0_tail_accepts(C0TailCalls *t, C0TailCall *tc) {
+	return tc->op == NULL || tc->op->kind == t->acc_kind;
+}
+
+static void c0_tail_find(C0TailCalls *t, C0Array(C0Instr *) array);
+
+static void c0_tail_find_instr(C0TailCalls *t, C0Instr *instr) {
+	if (instr->kind == C0Instr_loop) {
+		return; // a `continue` within would target the wrong loop
+	}
+	c0_tail_find(t, instr->nested_instrs);
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_tail_find_instr(t, instr->args[1]);
+	}
+}
+
+static void c0_tail_find(C0TailCalls *t, C0Array(C0Instr *) array) {
+	for (isize i = 0; i < c0array_len(array); i++) {
+		C0Instr *instr = array[i];
+		C0TailCall tc = {0};
+		if (instr->kind == C0Instr_return && c0_tail_match(t->p, array, i, &tc)) {
+			if (tc.op != NULL && t->acc_kind == C0Instr_invalid) {
+				t->acc_kind = tc.op->kind;
+				t->acc_type = tc.op->basic_type;
+			}
+			if (c0_tail_accepts(t, &tc)) {
+				t->count += 1;
+			}
+		}
+		c0_tail_find_instr(t, instr);
+	}
+}
+
+static C0Instr *c0_tail_push_decl(C0Proc *p, C0Array(C0Instr *) *out, C0BasicType type) {
+	C0Instr *decl = c0_instr_create(p, C0Instr_decl);
+	decl->basic_type = type;
+	decl->flags |= C0InstrFlag_addr_taken;
+	c0_instrs_push(p, out, decl);
+	return decl;
+}
+
+static C0Instr *c0_tail_push_op(C0TailCalls *t, C0Array(C0Instr *) *out, C0Instr *value) {
+	C0Instr *op = c0_instr_create(t->p, t->acc_kind);
+	op->basic_type = t->acc_type;
+	c0_alloc_args(t->p, op, 2);
+	op->args[0] = c0_use(t->acc);
+	op->args[1] = c0_use(value);
+	c0_instrs_push(t->p, out, op);
+	return op;
+}
+
+// Replaces `array[tc->call_index..ret_index]` with the stores and the `continue`
+static void c0_tail_rewrite(C0TailCalls *t, C0Array(C0Instr *) *out, C0Array(C0Instr *) array, isize ret_index, C0TailCall *tc) {
+	C0Proc *p = t->p;
+	C0Instr *call = tc->call;
+	for (isize i = tc->call_index+1; i < ret_index; i++) {
+		if (array[i] != tc->op) {
+			c0_instrs_push(t->p, out, array[i]);
+		}
+	}
+	if (array[ret_index]->args_len != 0) {
+		c0_unuse(array[ret_index]->args[0]);
+	}
+
+	if (tc->op != NULL) {
+		c0_unuse(tc->op->args[0]);
+		c0_unuse(tc->op->args[1]);
+		C0Instr *acc = c0_tail_push_op(t, out, tc->other);
+		c0_inline_push_store(p, out, t->acc, acc);
+	}
+
+	// values are printed where they are used, so with more than one
+	// parameter each argument is copied before any parameter is written to
+	C0AggType *sig = p->sig;
+	bool copy_args = c0array_len(p->parameters) > 1;
+	C0Array(C0Instr *) args = NULL;
+	isize param_index = 0;
+	for (isize i = 0; i < call->args_len; i++) {
+		C0Instr *arg = call->args[i];
+		if (i >= c0array_len(sig->proc.names) || sig->proc.names[i].len == 0) {
+			c0_unuse(arg);
+			continue;
+		}
+		C0Instr *param = p->parameters[param_index++];
+		if (copy_args && arg != param && !(arg->kind == C0Instr_decl && (arg->flags & C0InstrFlag_constant))) {
+			C0Instr *copy = c0_tail_push_decl(p, out, param->basic_type);
+			c0_inline_push_store(p, out, copy, arg);
+			c0_unuse(arg);
+			arg = copy;
+		} else {
+			c0_unuse(arg);
+		}
+		c0array_push(args, arg);
+	}
+	for (isize i = 0; i < c0array_len(args); i++) {
+		C0Instr *param = p->parameters[i];
+		if (args[i] != param) {
+			c0_inline_push_store(p, out, param, args[i]);
+		}
+	}
+	c0array_free(args);
+
+	c0_instrs_push(p, out, c0_instr_create(p, C0Instr_continue));
+}
+
+static void c0_tail_rewrite_block(C0TailCalls *t, C0Array(C0Instr *) *array, bool in_loop);
+
+static void c0_tail_rewrite_instr(C0TailCalls *t, C0Instr *instr, bool in_loop) {
+	if (instr->nested_instrs != NULL) {
+		c0_tail_rewrite_block(t, &instr->nested_instrs, in_loop || instr->kind == C0Instr_loop);
+		c0_block_update_terminating(instr);
+	}
+	if (instr->kind == C0Instr_if && instr->args_len == 2) {
+		c0_tail_rewrite_instr(t, instr->args[1], in_loop);
+	}
+}
+
+// calls within a nested loop are left alone, but their returns still need the accumulator
+static void c0_tail_rewrite_block(C0TailCalls *t, C0Array(C0Instr *) *array, bool in_loop) {
+	C0Array(C0Instr *) out = NULL;
+	isize start = 0; // first instruction of `*array` not yet moved to `out`
+	isize len = c0array_len(*array);
+	for (isize i = 0; i < len; i++) {
+		C0Instr *instr = (*array)[i];
+		c0_tail_rewrite_instr(t, instr, in_loop);
+		if (instr->kind != C0Instr_return) {
+			continue;
+		}
+
+		C0TailCall tc = {0};
+		if (!in_loop && c0_tail_match(t->p, *array, i, &tc) && c0_tail_accepts(t, &tc)) {
+			for (isize j = start; j < tc.call_index; j++) {
+				c0_instrs_push(t->p, &out, (*array)[j]);
+			}
+			c0_tail_rewrite(t, &out, *array, i, &tc);
+			start = i+1;
+		} else if (t->acc != NULL && instr->args_len != 0) {
+			// `return x` becomes `return acc op x`
+			for (isize j = start; j < i; j++) {
+				c0_instrs_push(t->p, &out, (*array)[j]);
+			}
+			C0Instr *value = instr->args[0];
+			instr->args[0] = c0_use(c0_tail_push_op(t, &out, value));
+			c0_unuse(value);
+			c0_instrs_push(t->p, &out, instr);
+			start = i+1;
+		}
+	}
+	if (start != 0) {
+		for (isize j = start; j < len; j++) {
+			c0_instrs_push(t->p, &out, (*array)[j]);
+		}
+		c0array_free(*array);
+		*array = out;
+	}
+}
+
+void c0_pass_tail_calls(C0Proc *p) {
+	C0AggType *sig = p->sig;
+	if (sig->proc.flags & C0ProcFlag_variadic) {
+		return;
+	}
+	for (isize i = 0; i < c0array_len(p->parameters); i++) {
+		if (p->parameters[i]->agg_type != NULL) {
+			return;
+		}
+	}
+
+	C0TailCalls t = {0};
+	t.p = p;
+	c0_tail_find(&t, p->instrs);
+	if (t.count == 0) {
+		return;
+	}
+
+	for (isize i = 0; i < c0array_len(p->parameters); i++) {
+		p->parameters[i]->flags |= C0InstrFlag_addr_taken;
+	}
+
+	C0Array(C0Instr *) body = NULL;
+	if (t.acc_kind != C0Instr_invalid) {
+		t.acc = c0_tail_push_decl(p, &body, t.acc_type);
+		t.acc->value_u64 = C0_KIND_IN(t.acc_kind, mul_u8, mul_u128) ? 1 : 0;
+	}
+
+	C0Instr *loop = c0_instr_create(p, C0Instr_loop);
+	c0_use(loop);
+	loop->nested_instrs = p->instrs;
+	c0_tail_rewrite_block(&t, &loop->nested_instrs, false);
+	c0_block_update_terminating(loop);
+	c0_instrs_push(p, &body, loop);
+	// the loop has no `break`, so control never leaves it other than through a return
+	c0_instrs_push(p, &body, c0_instr_create(p, C0Instr_unreachable));
+	p->instrs = body;
+}
+
+#undef C0_KIND_IN
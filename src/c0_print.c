@@ -3,6 +3,31 @@ enum C0PrinterFlag_enum {
 	C0PrinterFlag_UseInlineArgs = 1u<<0u,
 };
 
+typedef u8 C0PrinterOutputKind;
+enum C0PrinterOutputKind_enum {
+	C0PrinterOutput_stdout = 0, // default: written straight to `stdout`
+	C0PrinterOutput_buffer = 1, // accumulated into one contiguous buffer, see `c0_printer_contents`
+	C0PrinterOutput_fd     = 2, // accumulated and flushed to `fd` in large chunks
+};
+
+enum { C0_PRINTER_DEFAULT_FLUSH_SIZE = 1024*1024 };
+enum { C0_PRINTER_DEFAULT_RESERVE_SIZE = 256*1024*1024 };
+
+typedef u32 C0CdeclShape;
+enum C0CdeclShape_enum {
+	C0CdeclShape_named           = 1u<<0u, // declarator has a name, e.g. `u32 (x)[4]` rather than `u32 [4]`
+	C0CdeclShape_ignore_proc_ptr = 1u<<1u, // procedure declaration rather than a procedure pointer
+};
+
+// A formatted C declarator for a type: `prefix <name> suffix`
+typedef struct C0CdeclEntry C0CdeclEntry;
+struct C0CdeclEntry {
+	C0AggType *  type;
+	C0CdeclShape shape;
+	C0String     prefix;
+	C0String     suffix;
+};
+
 typedef struct C0Printer C0Printer;
 struct C0Printer {
 	C0PrinterFlags flags;
@@ -10,32 +35,198 @@ struct C0Printer {
 
 	void (*custom_vprintf)(C0Printer *p, char const *fmt, va_list va);
 	void *user_data;
+
+	C0PrinterOutputKind output;
+	int   fd;
+	usize flush_size;
+	usize reserve_size; // address space reserved for the output buffer, which moves to heap blocks beyond it
+
+	C0Arena buf_arena;
+	u8 *    buf_data;
+	usize   buf_len;
+	usize   buf_cap;
+
+	C0CdeclEntry *cdecl_entries; // open addressing, keyed by (type, shape)
+	usize         cdecl_len;
+	usize         cdecl_cap;
 };
 
+static void c0_platform_write_fd(int fd, void const *data, usize len);
+
+static void c0_printer_init_buf_arena(C0Printer *p) {
+	if (p->reserve_size == 0) {
+		p->reserve_size = C0_PRINTER_DEFAULT_RESERVE_SIZE;
+	}
+	c0_arena_init_reserve(&p->buf_arena, p->reserve_size);
+}
+
+void c0_printer_init_buffer(C0Printer *p) {
+	p->output = C0PrinterOutput_buffer;
+	p->fd = -1;
+	c0_printer_init_buf_arena(p);
+}
+
+void c0_printer_init_fd(C0Printer *p, int fd) {
+	p->output = C0PrinterOutput_fd;
+	p->fd = fd;
+	if (p->flush_size == 0) {
+		p->flush_size = C0_PRINTER_DEFAULT_FLUSH_SIZE;
+	}
+	c0_printer_init_buf_arena(p);
+}
+
+void c0_printer_flush(C0Printer *p) {
+	if (p->output == C0PrinterOutput_fd && p->buf_len != 0) {
+		c0_platform_write_fd(p->fd, p->buf_data, p->buf_len);
+		p->buf_len = 0;
+	}
+}
+
+// only valid for `C0PrinterOutput_buffer`, the memory is owned by the printer
+C0String c0_printer_contents(C0Printer *p) {
+	C0_ASSERT(p->output == C0PrinterOutput_buffer);
+	C0String res;
+	res.text = (char const *)p->buf_data;
+	res.len  = (isize)p->buf_len;
+	return res;
+}
+
+void c0_printer_destroy(C0Printer *p) {
+	c0_printer_flush(p);
+	c0_arena_destroy(&p->buf_arena);
+	c0_arena_destroy(&p->arena);
+	c0_heap_free(p->cdecl_entries);
+	p->buf_data = NULL;
+	p->buf_len  = 0;
+	p->buf_cap  = 0;
+	p->cdecl_entries = NULL;
+	p->cdecl_len     = 0;
+	p->cdecl_cap     = 0;
+}
+
+static u8 *c0_printer_reserve(C0Printer *p, usize n) {
+	if (p->buf_len + n <= p->buf_cap) {
+		return p->buf_data + p->buf_len;
+	}
+	if (p->output == C0PrinterOutput_fd) {
+		c0_printer_flush(p);
+		if (n <= p->buf_cap) {
+			return p->buf_data;
+		}
+	}
+
+	usize new_cap = 2*p->buf_cap;
+	if (new_cap < p->buf_len + n) {
+		new_cap = p->buf_len + n;
+	}
+	if (new_cap < p->flush_size) {
+		new_cap = p->flush_size;
+	}
+	if (new_cap < 4096) {
+		new_cap = 4096;
+	}
+
+	if (p->buf_data && c0_arena_try_grow(&p->buf_arena, p->buf_data, p->buf_cap, new_cap)) {
+		p->buf_cap = new_cap;
+		return p->buf_data + p->buf_len;
+	}
+
+	u8 *data = (u8 *)c0_arena_alloc(&p->buf_arena, new_cap, 1);
+	if (p->buf_len) {
+		memcpy(data, p->buf_data, p->buf_len);
+	}
+	p->buf_data = data;
+	p->buf_cap  = new_cap;
+	return p->buf_data + p->buf_len;
+}
+
 void c0_printf(C0Printer *p, char const *fmt, ...) {
 	va_list va;
 	va_start(va, fmt);
 	if (p->custom_vprintf) {
 		p->custom_vprintf(p, fmt, va);
+	} else if (p->output != C0PrinterOutput_stdout) {
+		usize avail = p->buf_cap - p->buf_len;
+		va_list vb;
+		va_copy(vb, va);
+		int n = vsnprintf((char *)p->buf_data + p->buf_len, avail, fmt, vb);
+		va_end(vb);
+		C0_ASSERT(n >= 0);
+		if ((usize)n >= avail) {
+			// +1 for the NUL which vsnprintf always writes
+			char *dst = (char *)c0_printer_reserve(p, (usize)n + 1);
+			vsnprintf(dst, (usize)n + 1, fmt, va);
+		}
+		p->buf_len += (usize)n;
 	} else {
 		vfprintf(stdout, fmt, va);
 	}
 	va_end(va);
 }
 
+// Fast paths which do not go through any format parsing
+
+void c0_print_bytes(C0Printer *p, void const *data, usize len) {
+	if (len == 0) {
+		return;
+	}
+	if (p->custom_vprintf) {
+		c0_printf(p, "%.*s", (int)len, (char const *)data);
+	} else if (p->output != C0PrinterOutput_stdout) {
+		u8 *dst = c0_printer_reserve(p, len);
+		memcpy(dst, data, len);
+		p->buf_len += len;
+	} else {
+		fwrite(data, 1, len, stdout);
+	}
+}
+
+#define c0_print_lit(p, lit) c0_print_bytes((p), (lit), sizeof(lit)-1)
+
+void c0_print_str(C0Printer *p, char const *str) {
+	c0_print_bytes(p, str, strlen(str));
+}
+
+void c0_print_string(C0Printer *p, C0String str) {
+	c0_print_bytes(p, str.text, (usize)str.len);
+}
+
+void c0_print_u64(C0Printer *p, u64 value) {
+	char buf[24];
+	char *end = buf + sizeof(buf);
+	char *ptr = end;
+	do {
+		*--ptr = (char)('0' + value%10);
+		value /= 10;
+	} while (value);
+	c0_print_bytes(p, ptr, end-ptr);
+}
+
+void c0_print_i64(C0Printer *p, i64 value) {
+	if (value < 0) {
+		c0_print_bytes(p, "-", 1);
+		c0_print_u64(p, -(u64)value);
+	} else {
+		c0_print_u64(p, (u64)value);
+	}
+}
+
 
 void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent);
 
 void c0_print_indent(C0Printer *p, usize indent) {
-	while (indent --> 0) {
-		c0_printf(p, "\t");
+	static char const tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	while (indent > 0) {
+		usize n = indent < sizeof(tabs)-1 ? indent : sizeof(tabs)-1;
+		c0_print_bytes(p, tabs, n);
+		indent -= n;
 	}
 }
 
 void c0_print_agg_type(C0Printer *p, C0AggType *type, C0String name) {
 	switch (type->kind) {
 	case C0AggType_basic:
-		c0_printf(p, "%s", c0_basic_names[type->basic.type]);
+		c0_print_str(p, c0_basic_names[type->basic.type]);
 		break;
 
 	case C0AggType_array:
@@ -64,21 +255,25 @@ bool c0_print_instr_type(C0Printer *p, C0Instr *instr) {
 		c0_print_agg_type(p, instr->agg_type, empty_name);
 		return true;
 	} else if (instr->basic_type != C0Basic_void) {
-		c0_printf(p, "%s", c0_basic_names[instr->basic_type]);
+		c0_print_str(p, c0_basic_names[instr->basic_type]);
 		return true;
 	}
 	return false;
 }
+void c0_print_instr_name(C0Printer *p, C0Instr *instr) {
+	if (instr->name.len != 0) {
+		c0_print_string(p, instr->name);
+	} else {
+		c0_print_lit(p, "_C0_");
+		c0_print_u64(p, instr->id);
+	}
+}
 void c0_print_instr_arg(C0Printer *p, C0Instr *instr, usize indent) {
 	if (instr->flags & C0InstrFlag_print_inline) {
 		c0_print_instr_expr(p, instr, indent);
 		return;
 	}
-	if (instr->name.len != 0) {
-		c0_printf(p, "%.*s", C0PSTR(instr->name));
-	} else {
-		c0_printf(p, "_C0_%u", instr->id);
-	}
+	c0_print_instr_name(p, instr);
 }
 
 static char *strf_alloc(C0Arena *a, usize n) {
@@ -183,36 +378,104 @@ static char *c0_type_to_cdecl_internal(C0Arena *a, C0AggType *type, char const *
 	return NULL;
 }
 
+static usize c0_cdecl_hash(C0AggType *type, C0CdeclShape shape) {
+	u64 h = ((u64)(uintptr_t)type >> 3) ^ ((u64)shape << 59);
+	h *= 0x9e3779b97f4a7c15ull;
+	return (usize)(h >> 32);
+}
+
+static C0CdeclEntry *c0_printer_cdecl(C0Printer *p, C0AggType *type, C0CdeclShape shape) {
+	if (p->cdecl_cap) {
+		usize mask = p->cdecl_cap-1;
+		for (usize i = c0_cdecl_hash(type, shape) & mask; ; i = (i+1) & mask) {
+			C0CdeclEntry *e = &p->cdecl_entries[i];
+			if (e->type == NULL) {
+				break;
+			}
+			if (e->type == type && e->shape == shape) {
+				return e;
+			}
+		}
+	}
+
+	if (2*(p->cdecl_len+1) > p->cdecl_cap) {
+		usize old_cap = p->cdecl_cap;
+		C0CdeclEntry *old_entries = p->cdecl_entries;
+		p->cdecl_cap = old_cap ? 2*old_cap : 64;
+		p->cdecl_entries = (C0CdeclEntry *)c0_heap_calloc(sizeof(C0CdeclEntry), p->cdecl_cap);
+		for (usize j = 0; j < old_cap; j++) {
+			C0CdeclEntry *e = &old_entries[j];
+			if (e->type != NULL) {
+				usize mask = p->cdecl_cap-1;
+				usize i = c0_cdecl_hash(e->type, e->shape) & mask;
+				while (p->cdecl_entries[i].type != NULL) {
+					i = (i+1) & mask;
+				}
+				p->cdecl_entries[i] = *e;
+			}
+		}
+		c0_heap_free(old_entries);
+	}
+
+	char const placeholder = '\x01';
+	char const placeholder_str[2] = {placeholder, 0};
+	char const *name = (shape & C0CdeclShape_named) ? placeholder_str : "";
+	C0ArenaTemp scratch = c0_scratch_begin(&p->arena);
+	char const *scratch_text = c0_type_to_cdecl_internal(scratch.arena, type, name, (shape & C0CdeclShape_ignore_proc_ptr) != 0);
+	isize len = (isize)strlen(scratch_text);
+	char *text = strf_alloc(&p->arena, len+1);
+	memmove(text, scratch_text, len);
+	c0_scratch_end(scratch);
+	char const *split = (shape & C0CdeclShape_named) ? strchr(text, placeholder) : NULL;
+
+	C0CdeclEntry entry = {0};
+	entry.type  = type;
+	entry.shape = shape;
+	entry.prefix.text = text;
+	entry.prefix.len  = split ? split-text : len;
+	if (split) {
+		entry.suffix.text = split+1;
+		entry.suffix.len  = len - entry.prefix.len - 1;
+	}
+
+	usize mask = p->cdecl_cap-1;
+	usize i = c0_cdecl_hash(type, shape) & mask;
+	while (p->cdecl_entries[i].type != NULL) {
+		i = (i+1) & mask;
+	}
+	p->cdecl_entries[i] = entry;
+	p->cdecl_len += 1;
+	return &p->cdecl_entries[i];
+}
+
 static void c0_print_instr_creation(C0Printer *p, C0Instr *instr) {
 	if (instr->agg_type && instr->kind != C0Instr_index_ptr && instr->kind != C0Instr_field_ptr) {
 		switch (instr->agg_type->kind) {
 		case C0AggType_basic:
 			if (instr->agg_type->basic.type != C0Basic_void) {
-				c0_printf(p, "%s ", c0_basic_names[instr->basic_type]);
+				c0_print_str(p, c0_basic_names[instr->basic_type]);
+				c0_print_lit(p, " ");
 				c0_print_instr_arg(p, instr, 0);
-				c0_printf(p, " = ");
+				c0_print_lit(p, " = ");
 			}
 			return;
 		}
-		char const *name = NULL;
-		if (instr->name.len != 0) {
-			name = c0_string_to_cstr(&p->arena, instr->name);
-		} else {
-			name = strf(&p->arena, "_C0_%u", instr->id);
-		}
-		c0_printf(p, "%s = ", c0_type_to_cdecl(&p->arena, instr->agg_type, name));
+		C0CdeclEntry *cdecl = c0_printer_cdecl(p, instr->agg_type, C0CdeclShape_named);
+		c0_print_string(p, cdecl->prefix);
+		c0_print_instr_name(p, instr);
+		c0_print_string(p, cdecl->suffix);
+		c0_print_lit(p, " = ");
 	} else if (instr->basic_type != C0Basic_void) {
-		c0_printf(p, "%s", c0_basic_names[instr->basic_type]);
+		c0_print_str(p, c0_basic_names[instr->basic_type]);
 		if (instr->basic_type != C0Basic_ptr) {
-			c0_printf(p, " ");
+			c0_print_lit(p, " ");
 		}
 		c0_print_instr_arg(p, instr, 0);
-		c0_printf(p, " = ");
+		c0_print_lit(p, " = ");
 	}
 }
 
 void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
-	C0_ASSERT(instr->agg_type != NULL || instr->basic_type != C0Basic_void);
 	switch (instr->kind) {
 	case C0Instr_invalid:
 		c0_errorf("unhandled instruction kind");
@@ -224,13 +487,13 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 		case C0Basic_i16:
 		case C0Basic_i32:
 		case C0Basic_i64:
-			c0_printf(p, "%lld", (long long)instr->value_i64);
+			c0_print_i64(p, instr->value_i64);
 			break;
 		case C0Basic_u8:
 		case C0Basic_u16:
 		case C0Basic_u32:
 		case C0Basic_u64:
-			c0_printf(p, "%llu", (unsigned long long)instr->value_u64);
+			c0_print_u64(p, instr->value_u64);
 			break;
 		case C0Basic_i128:
 		case C0Basic_u128:
@@ -249,16 +512,16 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 			c0_printf(p, "%llx", (unsigned long long)instr->value_u64);
 			break;
 		default:
-			c0_printf(p, "{0}");
+			c0_print_lit(p, "{0}");
 		}
 		return;
 
 	case C0Instr_addr:
 		C0_ASSERT(instr->basic_type == C0Basic_ptr);
 		C0_ASSERT(instr->args_len == 1);
-		c0_printf(p, "_C0_addr(");
+		c0_print_lit(p, "_C0_addr(");
 		c0_print_instr_arg(p, instr->args[0], indent);
-		c0_printf(p, ")");
+		c0_print_lit(p, ")");
 		return;
 
 
@@ -266,20 +529,20 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 		C0_ASSERT(instr->args_len == 1);
 		c0_printf(p, "_C0_convert_%s_to_%s(", c0_basic_names[instr->args[0]->basic_type], c0_basic_names[instr->basic_type]);
 		c0_print_instr_arg(p, instr->args[0], indent);
-		c0_printf(p, ")");
+		c0_print_lit(p, ")");
 		return;
 	case C0Instr_reinterpret:
 		C0_ASSERT(instr->args_len == 1);
 		c0_printf(p, "_C0_reinterpret_%s_to_%s(", c0_basic_names[instr->args[0]->basic_type], c0_basic_names[instr->basic_type]);
 		c0_print_instr_arg(p, instr->args[0], indent);
-		c0_printf(p, ")");
+		c0_print_lit(p, ")");
 		return;
 
 	case C0Instr_atomic_thread_fence:
 	case C0Instr_atomic_signal_fence:
 	case C0Instr_memmove:
 	case C0Instr_memset:
-		c0_printf(p, "%s", c0_instr_names[instr->kind]);
+		c0_print_str(p, c0_instr_names[instr->kind]);
 		break;
 
 	case C0Instr_select_u8:
@@ -293,19 +556,23 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 	case C0Instr_select_ptr:
 		C0_ASSERT(instr->args_len == 3);
 		c0_print_instr_arg(p, instr->args[0], 0);
-		c0_printf(p, " ? ");
+		c0_print_lit(p, " ? ");
 		c0_print_instr_arg(p, instr->args[1], 0);
-		c0_printf(p, " : ");
+		c0_print_lit(p, " : ");
 		c0_print_instr_arg(p, instr->args[2], 0);
 		return;
 
 	case C0Instr_index_ptr:
 		C0_ASSERT(instr->args_len == 2);
-		c0_printf(p, "_C0_%s(%s, ", c0_instr_names[instr->kind], c0_type_to_cdecl(&p->arena, instr->agg_type->array.elem, ""));
+		c0_print_lit(p, "_C0_");
+		c0_print_str(p, c0_instr_names[instr->kind]);
+		c0_print_lit(p, "(");
+		c0_print_string(p, c0_printer_cdecl(p, instr->agg_type->array.elem, 0)->prefix);
+		c0_print_lit(p, ", ");
 		c0_print_instr_arg(p, instr->args[0], 0);
-		c0_printf(p, ", ");
+		c0_print_lit(p, ", ");
 		c0_print_instr_arg(p, instr->args[1], 0);
-		c0_printf(p, ")");
+		c0_print_lit(p, ")");
 		return;
 	case C0Instr_field_ptr:
 		{
@@ -313,24 +580,29 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 			C0_ASSERT(instr->agg_type && instr->agg_type->kind == C0AggType_record);
 			C0_ASSERT(instr->value_u64 < (u64)c0array_len(instr->agg_type->record.names));
 			C0String field_name = instr->agg_type->record.names[instr->value_u64];
-			c0_printf(p, "_C0_%s(%s, ", c0_instr_names[instr->kind], c0_type_to_cdecl(&p->arena, instr->agg_type, ""));
+			c0_print_lit(p, "_C0_");
+			c0_print_str(p, c0_instr_names[instr->kind]);
+			c0_print_lit(p, "(");
+			c0_print_string(p, c0_printer_cdecl(p, instr->agg_type, 0)->prefix);
+			c0_print_lit(p, ", ");
 			c0_print_instr_arg(p, instr->args[0], 0);
 			c0_printf(p, ", %.*s", C0PSTR(field_name));
-			c0_printf(p, ")");
+			c0_print_lit(p, ")");
 		}
 		return;
 
 	case C0Instr_call:
 		C0_ASSERT(instr->call_proc);
-		c0_printf(p, "%.*s", C0PSTR(instr->call_proc->name));
+		c0_print_string(p, instr->call_proc->name);
 		break;
 
 	default:
-		c0_printf(p, "_C0_%s", c0_instr_names[instr->kind]);
+		c0_print_lit(p, "_C0_");
+		c0_print_str(p, c0_instr_names[instr->kind]);
 		break;
 	}
 
-	c0_printf(p, "(");
+	c0_print_lit(p, "(");
 	bool any_inline = false;
 	bool any_call = false;
 	if (instr->args_len > 1) {
@@ -347,7 +619,7 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 
 	bool do_indent = any_inline && any_call;
 	if (do_indent) {
-		c0_printf(p, "\n");
+		c0_print_lit(p, "\n");
 	}
 	if (do_indent) {
 		for (isize i = 0; i < instr->args_len; i++) {
@@ -355,14 +627,14 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 			c0_print_indent(p, indent+1);
 			c0_print_instr_arg(p, arg, indent+1);
 			if (i+1 < instr->args_len) {
-				c0_printf(p, ",");
+				c0_print_lit(p, ",");
 			}
-			c0_printf(p, "\n");
+			c0_print_lit(p, "\n");
 		}
 	} else {
 		for (isize i = 0; i < instr->args_len; i++) {
 			if (i != 0) {
-				c0_printf(p, ", ");
+				c0_print_lit(p, ", ");
 			}
 			C0Instr *arg = instr->args[i];
 			c0_print_instr_arg(p, arg, indent);
@@ -371,7 +643,7 @@ void c0_print_instr_expr(C0Printer *p, C0Instr *instr, usize indent) {
 	if (do_indent) {
 		c0_print_indent(p, indent);
 	}
-	c0_printf(p, ")");
+	c0_print_lit(p, ")");
 }
 
 bool c0_instr_can_be_printed_inline_as_condition(C0Instr *instr) {
@@ -436,7 +708,8 @@ void c0_print_instr(C0Printer *p, C0Instr *instr, usize indent, bool ignore_firs
 	}
 
 	if (instr->kind == C0Instr_label) {
-		c0_printf(p, "%.*s:;\n", C0PSTR(instr->name));
+		c0_print_string(p, instr->name);
+		c0_print_lit(p, ":;\n");
 		return;
 	}
 	if (!ignore_first_identation) {
@@ -445,66 +718,68 @@ void c0_print_instr(C0Printer *p, C0Instr *instr, usize indent, bool ignore_firs
 
 	switch (instr->kind) {
 	case C0Instr_continue:
-		c0_printf(p, "continue;\n");
+		c0_print_lit(p, "continue;\n");
 		return;
 	case C0Instr_break:
-		c0_printf(p, "break;\n");
+		c0_print_lit(p, "break;\n");
 		return;
 	case C0Instr_return:
-		c0_printf(p, "return");
+		c0_print_lit(p, "return");
 		if (instr->args_len != 0) {
 			C0_ASSERT(instr->args_len == 1);
-			c0_printf(p, " ");
+			c0_print_lit(p, " ");
 			C0Instr *arg = instr->args[0];
 			c0_instr_print_inline_as_condition(p, arg);
 			c0_print_instr_arg(p, arg, indent);
 		}
-		c0_printf(p, ";\n");
+		c0_print_lit(p, ";\n");
 		return;
 	case C0Instr_unreachable:
-		c0_printf(p, "_C0_unreachable();\n");
+		c0_print_lit(p, "_C0_unreachable();\n");
 		return;
 	case C0Instr_goto:
 		C0_ASSERT(instr->args_len == 1);
 		C0_ASSERT(instr->args[0]->kind == C0Instr_label);
-		c0_printf(p, "goto %.*s;\n", C0PSTR(instr->args[0]->name));
+		c0_print_lit(p, "goto ");
+		c0_print_string(p, instr->args[0]->name);
+		c0_print_lit(p, ";\n");
 		return;
 
 	case C0Instr_if:
 		C0_ASSERT(instr->args_len >= 1);
-		c0_printf(p, "if (");
+		c0_print_lit(p, "if (");
 		c0_instr_print_inline_as_condition(p, instr->args[0]);
 		c0_print_instr_arg(p, instr->args[0], indent);
-		c0_printf(p, ") {\n");
+		c0_print_lit(p, ") {\n");
 		for (isize i = 0; i < c0array_len(instr->nested_instrs); i++) {
 			c0_print_instr(p, instr->nested_instrs[i], indent+1, false);
 		}
 		c0_print_indent(p, indent);
-		c0_printf(p, "}");
+		c0_print_lit(p, "}");
 		if (instr->args_len == 2) {
-			c0_printf(p, " else ");
+			c0_print_lit(p, " else ");
 			c0_print_instr(p, instr->args[1], indent, true);
 		} else {
-			c0_printf(p, "\n");
+			c0_print_lit(p, "\n");
 		}
 		return;
 
 	case C0Instr_loop:
-		c0_printf(p, "for (;;) {\n");
+		c0_print_lit(p, "for (;;) {\n");
 		for (isize i = 0; i < c0array_len(instr->nested_instrs); i++) {
 			c0_print_instr(p, instr->nested_instrs[i], indent+1, false);
 		}
 		c0_print_indent(p, indent);
-		c0_printf(p, "}\n");
+		c0_print_lit(p, "}\n");
 		return;
 
 	case C0Instr_block:
-		c0_printf(p, "{\n");
+		c0_print_lit(p, "{\n");
 		for (isize i = 0; i < c0array_len(instr->nested_instrs); i++) {
 			c0_print_instr(p, instr->nested_instrs[i], indent+1, false);
 		}
 		c0_print_indent(p, indent);
-		c0_printf(p, "}\n");
+		c0_print_lit(p, "}\n");
 		return;
 	}
 
@@ -514,61 +789,61 @@ void c0_print_instr(C0Printer *p, C0Instr *instr, usize indent, bool ignore_firs
 
 	c0_print_instr_creation(p, instr);
 	c0_print_instr_expr(p, instr, indent);
-	c0_printf(p, ";\n");
+	c0_print_lit(p, ";\n");
 }
 
 void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
-	c0_printf(p, "#if !defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L)\n");
-	c0_printf(p, "#error C0 requires a C11 compiler\n");
-	c0_printf(p, "#endif\n\n");
-	c0_printf(p, "#define C0_GENERATED 1\n\n");
-
-	c0_printf(p, "#if defined(_MSC_VER)\n");
-	c0_printf(p, "#define C0_FORCE_INLINE __forceinline\n");
-	c0_printf(p, "#else\n");
-	c0_printf(p, "#define C0_FORCE_INLINE __attribute__((always_inline)) inline\n");
-	c0_printf(p, "#endif\n\n");
-
-	c0_printf(p, "#define C0_INSTRUCTION static C0_FORCE_INLINE\n");
-
-	c0_printf(p, "typedef signed   char      i8;\n");
-	c0_printf(p, "typedef unsigned char      u8;\n");
-	c0_printf(p, "typedef signed   short     i16;\n");
-	c0_printf(p, "typedef unsigned short     u16;\n");
-	c0_printf(p, "typedef signed   int       i32;\n");
-	c0_printf(p, "typedef unsigned int       u32;\n");
-	c0_printf(p, "typedef signed   long long i64;\n");
-	c0_printf(p, "typedef unsigned long long u64;\n");
+	c0_print_lit(p, "#if !defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L)\n");
+	c0_print_lit(p, "#error C0 requires a C11 compiler\n");
+	c0_print_lit(p, "#endif\n\n");
+	c0_print_lit(p, "#define C0_GENERATED 1\n\n");
+
+	c0_print_lit(p, "#if defined(_MSC_VER)\n");
+	c0_print_lit(p, "#define C0_FORCE_INLINE __forceinline\n");
+	c0_print_lit(p, "#else\n");
+	c0_print_lit(p, "#define C0_FORCE_INLINE __attribute__((always_inline)) inline\n");
+	c0_print_lit(p, "#endif\n\n");
+
+	c0_print_lit(p, "#define C0_INSTRUCTION static C0_FORCE_INLINE\n");
+
+	c0_print_lit(p, "typedef signed   char      i8;\n");
+	c0_print_lit(p, "typedef unsigned char      u8;\n");
+	c0_print_lit(p, "typedef signed   short     i16;\n");
+	c0_print_lit(p, "typedef unsigned short     u16;\n");
+	c0_print_lit(p, "typedef signed   int       i32;\n");
+	c0_print_lit(p, "typedef unsigned int       u32;\n");
+	c0_print_lit(p, "typedef signed   long long i64;\n");
+	c0_print_lit(p, "typedef unsigned long long u64;\n");
 	if (gen->endian == C0Endian_big) {
-		c0_printf(p, "typedef struct i128 { u64 hi; u64 lo; } i128;\n");
-		c0_printf(p, "typedef struct u128 { u64 hi; u64 lo; } u128;\n");
+		c0_print_lit(p, "typedef struct i128 { u64 hi; u64 lo; } i128;\n");
+		c0_print_lit(p, "typedef struct u128 { u64 hi; u64 lo; } u128;\n");
 	} else {
-		c0_printf(p, "typedef struct i128 { u64 lo; u64 hi; } i128;\n");
-		c0_printf(p, "typedef struct u128 { u64 lo; u64 hi; } u128;\n");
+		c0_print_lit(p, "typedef struct i128 { u64 lo; u64 hi; } i128;\n");
+		c0_print_lit(p, "typedef struct u128 { u64 lo; u64 hi; } u128;\n");
 	}
-	c0_printf(p, "typedef unsigned short     f16;\n");
-	c0_printf(p, "typedef float              f32;\n");
-	c0_printf(p, "typedef double             f64;\n");
+	c0_print_lit(p, "typedef unsigned short     f16;\n");
+	c0_print_lit(p, "typedef float              f32;\n");
+	c0_print_lit(p, "typedef double             f64;\n");
 
-	c0_printf(p, "\n");
+	c0_print_lit(p, "\n");
 
 	if (gen->instrs_to_generate[C0Instr_memmove] || gen->instrs_to_generate[C0Instr_memset]) {
-		c0_printf(p, "#include <string.h>\n");
+		c0_print_lit(p, "#include <string.h>\n");
 	}
 
 	if (gen->instrs_to_generate[C0Instr_unreachable]) {
 		char const *name = c0_instr_names[C0Instr_unreachable];
 		c0_printf(p, "C0_INSTRUCTION _Noreturn void _C0_%s(void) {\n", name);
-		c0_printf(p, "#if defined(_MSC_VER)\n");
-		c0_printf(p, "\t__assume(false);\n");
-		c0_printf(p, "#else\n");
-		c0_printf(p, "\t__builtin_unreachable();\n");
-		c0_printf(p, "#endif\n");
-		c0_printf(p, "}\n\n");
+		c0_print_lit(p, "#if defined(_MSC_VER)\n");
+		c0_print_lit(p, "\t__assume(false);\n");
+		c0_print_lit(p, "#else\n");
+		c0_print_lit(p, "\t__builtin_unreachable();\n");
+		c0_print_lit(p, "#endif\n");
+		c0_print_lit(p, "}\n\n");
 	}
 
 	if (gen->instrs_to_generate[C0Instr_addr]) {
-		c0_printf(p, "#define _C0_addr(x) (void *)(&(x))\n\n");
+		c0_print_lit(p, "#define _C0_addr(x) (void *)(&(x))\n\n");
 	}
 
 	if (gen->instrs_to_generate[C0Instr_index_ptr]) {
@@ -578,14 +853,14 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 		c0_printf(p, "#define _C0_%s(RECORD_TYPE, ptr, field) (void *)&(((RECORD_TYPE *)(ptr))->field\n\n", c0_instr_names[C0Instr_field_ptr]);
 	}
 
-	static char const *masks[16] = {};
+	static char const *masks[17] = {};
 	masks[1] = "0xff";
 	masks[2] = "0xffff";
 	masks[4] = "0xffffffff";
 	masks[8] = "0xffffffffffffffff";
 	masks[16] = "(u128){0xffffffffffffffff, 0xffffffffffffffff}";
 
-	static char const *shift_masks[16] = {};
+	static char const *shift_masks[17] = {};
 	shift_masks[1] = "0x7";
 	shift_masks[2] = "0xf";
 	shift_masks[4] = "0x1f";
@@ -658,18 +933,18 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 					c0_printf(p, "\t%s x;\n", rs);
 					c0_printf(p, "\tx.lo = a.lo %s b.lo;\n", c0_instr_symbols[kind]);
 					c0_printf(p, "\tx.hi = a.hi %s b.hi;\n", c0_instr_symbols[kind]);
-					c0_printf(p, "\t return x;\n");
-					c0_printf(p, "}\n\n");
+					c0_print_lit(p, "\t return x;\n");
+					c0_print_lit(p, "}\n\n");
 					continue;
 				case C0Instr_eq_u128:
 					c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 					c0_printf(p, "\treturn (%s)((a.lo == b.lo) & (a.hi == b.hi));\n", rs);
-					c0_printf(p, "}\n\n");
+					c0_print_lit(p, "}\n\n");
 					continue;
 				case C0Instr_neq_u128:
 					c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 					c0_printf(p, "\treturn (%s)((a.lo != b.lo) | (a.hi != b.hi));\n", rs);
-					c0_printf(p, "}\n\n");
+					c0_print_lit(p, "}\n\n");
 					continue;
 				case C0Instr_lt_i128:
 				case C0Instr_lt_u128:
@@ -703,20 +978,20 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 			}
 
 
-			if (C0Instr_load_u8 <= kind && kind <= C0Instr_load_u128) {
+			if (C0Instr_load_u8 <= kind && kind <= C0Instr_load_ptr) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(void *ptr) {\n", rs, name);
 				c0_printf(p, "\treturn *(%s *)(ptr);\n", rs);
-				c0_printf(p, "}\n\n");
-			} else if (C0Instr_store_u8 <= kind && kind <= C0Instr_store_u128) {
+				c0_print_lit(p, "}\n\n");
+			} else if (C0Instr_store_u8 <= kind && kind <= C0Instr_store_ptr) {
 				c0_printf(p, "C0_INSTRUCTION void _C0_%s(void *dst, %s src) {\n", name, ts);
 				c0_printf(p, "\t*(%s *)(dst) = src;\n", ts);
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_clz_u8 <= kind && kind <= C0Instr_popcnt_u128) {
 				c0_errorf("TODO: generate %s", c0_instr_names[kind]);
 			} else if (C0Instr_abs_i8 <= kind && kind <= C0Instr_abs_i128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a) {\n", rs, name, ts);
-				c0_printf(p, "\treturn (a < 0)  -a : a;\n");
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "\treturn (a < 0)  -a : a;\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_add_u8 <= kind && kind <= C0Instr_add_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\t%s x = (%s)a + (%s)b;\n", uts, uts, uts);
@@ -726,7 +1001,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_sub_u8 <= kind && kind <= C0Instr_sub_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\t%s x = (%s)a - (%s)b;\n", uts, uts, uts);
@@ -736,7 +1011,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_mul_u8 <= kind && kind <= C0Instr_mul_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\t%s x = (%s)a * (%s)b;\n", uts, uts, uts);
@@ -746,13 +1021,13 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_quo_i8 <= kind && kind <= C0Instr_quo_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s volatile b) {\n", rs, name, ts, ts);
 				if (c0_basic_is_signed[type]) {
-					c0_printf(p, "\ni64 x = (i64)a / (i64)b;\n");
+					c0_print_lit(p, "\ni64 x = (i64)a / (i64)b;\n");
 				} else {
-					c0_printf(p, "\nu64 x = (u64)a / (u64)b;\n");
+					c0_print_lit(p, "\nu64 x = (u64)a / (u64)b;\n");
 				}
 				char const *mask = masks[bytes];
 				if (mask) {
@@ -760,7 +1035,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_rem_i8 <= kind && kind <= C0Instr_rem_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s volatile b) {\n", rs, name, ts, ts);
 				if (c0_basic_is_signed[type]) {
@@ -774,7 +1049,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_shlc_i8 <= kind && kind <= C0Instr_shlc_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				if (c0_basic_is_signed[type]) {
@@ -788,7 +1063,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_shlo_i8 <= kind && kind <= C0Instr_shlo_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\ni64 x = b < %d ? ((i64)a << (i64)((u32)b & %s)) : 0;\n", bits, shift_masks[bytes]);
@@ -798,7 +1073,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_shrc_i8 <= kind && kind <= C0Instr_shrc_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				if (c0_basic_is_signed[type]) {
@@ -812,7 +1087,7 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (C0Instr_shro_i8 <= kind && kind <= C0Instr_shro_u128) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\ni64 x = b < %d ? ((i64)a >> (i64)((u32)b & %s)) : 0;\n", bits, shift_masks[bytes]);
@@ -822,11 +1097,11 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)(x);\n", rs);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (c0_instr_arg_count[kind] == 2 && *c0_instr_symbols[kind]) {
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s(%s a, %s b) {\n", rs, name, ts, ts);
 				c0_printf(p, "\t return (%s)(a %s b);\n", rs, c0_instr_symbols[kind]);
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else {
 				c0_errorf("TODO: generate %s", c0_instr_names[kind]);
 			}
@@ -850,26 +1125,122 @@ void c0_gen_instructions_print(C0Printer *p, C0Gen *gen) {
 				} else {
 					c0_printf(p, "\treturn (%s)a;\n", to_s);
 				}
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "}\n\n");
 			} else if (gen->reinterpret_to_generate[from][to]) {
 				char const *name = c0_instr_names[C0Instr_reinterpret];
 				char const *from_s = c0_basic_names[from];
 				char const *to_s   = c0_basic_names[to];
 				c0_printf(p, "C0_INSTRUCTION %s _C0_%s_%s_to_%s(%s a) {\n", to_s, name, from_s, to_s, from_s);
 				c0_printf(p, "\tunion {%s from; %s to} x;\n", from_s, to_s);
-				c0_printf(p, "\tx.from = a;\n");
-				c0_printf(p, "\treturn x.to;\n");
-				c0_printf(p, "}\n\n");
+				c0_print_lit(p, "\tx.from = a;\n");
+				c0_print_lit(p, "\treturn x.to;\n");
+				c0_print_lit(p, "}\n\n");
 			}
 		}
 	}
 }
 
 void c0_print_proc(C0Printer *p, C0Proc *procedure) {
-	C0Arena *a = &p->arena;
-	c0_printf(p, "%s {\n", c0_type_to_cdecl_internal(a, procedure->sig, c0_string_to_cstr(a, procedure->name), true));
+	C0CdeclEntry *cdecl = c0_printer_cdecl(p, procedure->sig, C0CdeclShape_named|C0CdeclShape_ignore_proc_ptr);
+	if (procedure->linkage == C0ProcLinkage_private) {
+		c0_print_lit(p, "static ");
+	}
+	c0_print_string(p, cdecl->prefix);
+	c0_print_string(p, procedure->name);
+	c0_print_string(p, cdecl->suffix);
+	c0_print_lit(p, " {\n");
 	for (isize i = 0; i < c0array_len(procedure->instrs); i++) {
 		c0_print_instr(p, procedure->instrs[i], 1, false);
 	}
-	c0_printf(p, "}\n\n");
-}
\ No newline at end of file
+	c0_print_lit(p, "}\n\n");
+}
+
+typedef struct C0PrintProcRange C0PrintProcRange;
+struct C0PrintProcRange {
+	usize worker;
+	usize offset;
+	usize len;
+};
+
+typedef struct C0PrintWorker C0PrintWorker;
+struct C0PrintWorker {
+	C0Printer printer;
+	C0Thread  thread;
+
+	C0Gen *           gen;
+	C0PrintProcRange *ranges;
+	usize             index;
+	C0Atomic(usize) * next_proc;
+};
+
+static void c0_print_worker_proc(void *data) {
+	C0PrintWorker *w = (C0PrintWorker *)data;
+	usize n = c0array_len(w->gen->procs);
+	for (;;) {
+		usize i = c0_atomic_fetch_add(w->next_proc, 1);
+		if (i >= n) {
+			break;
+		}
+		usize offset = w->printer.buf_len;
+		c0_print_proc(&w->printer, w->gen->procs[i]);
+		w->ranges[i].worker = w->index;
+		w->ranges[i].offset = offset;
+		w->ranges[i].len    = w->printer.buf_len - offset;
+	}
+	if (w->index != 0) {
+		// worker 0 is the calling thread which may still want its scratch arenas
+		c0_scratch_destroy();
+	}
+}
+
+// Prints every procedure in `gen->procs` into `p`, producing the same bytes as
+// calling `c0_print_proc` on each of them in order
+// Each worker prints into its own buffer, which reserves `p->reserve_size` of address space, and
+// formats cdecls in a scratch arena, which reserves another 4 GiB while the worker runs
+void c0_gen_print_parallel(C0Printer *p, C0Gen *gen, usize thread_count) {
+	usize n = c0array_len(gen->procs);
+	if (thread_count > n) {
+		thread_count = n;
+	}
+	if (thread_count <= 1 || p->custom_vprintf) {
+		for (usize i = 0; i < n; i++) {
+			c0_print_proc(p, gen->procs[i]);
+		}
+		return;
+	}
+
+	C0Atomic(usize) next_proc;
+	c0_atomic_store(&next_proc, 0);
+
+	C0PrintProcRange *ranges = (C0PrintProcRange *)c0_heap_calloc(sizeof(C0PrintProcRange), n);
+	C0PrintWorker *workers = (C0PrintWorker *)c0_heap_calloc(sizeof(C0PrintWorker), thread_count);
+	for (usize i = 0; i < thread_count; i++) {
+		C0PrintWorker *w = &workers[i];
+		w->printer.flags = p->flags;
+		w->printer.reserve_size = p->reserve_size;
+		c0_printer_init_buffer(&w->printer);
+		w->gen       = gen;
+		w->ranges    = ranges;
+		w->index     = i;
+		w->next_proc = &next_proc;
+	}
+
+	for (usize i = 1; i < thread_count; i++) {
+		c0_thread_start(&workers[i].thread, c0_print_worker_proc, &workers[i]);
+	}
+	c0_print_worker_proc(&workers[0]);
+	for (usize i = 1; i < thread_count; i++) {
+		c0_thread_join(&workers[i].thread);
+	}
+
+	for (usize i = 0; i < n; i++) {
+		C0PrintProcRange r = ranges[i];
+		c0_print_bytes(p, workers[r.worker].printer.buf_data + r.offset, r.len);
+	}
+
+	for (usize i = 0; i < thread_count; i++) {
+		c0_printer_destroy(&workers[i].printer);
+	}
+	c0_heap_free(workers);
+	c0_heap_free(ranges);
+}
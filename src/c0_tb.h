@@ -1,33 +1,1137 @@
 #include "../tb.h"
 
+///////////////////////////////////////////////////////////////////////////////
+// Tilde Backend
+//
+// Lowers finished procedures to TB functions. Every procedure of a generator
+// is declared when the module is set up so a call may refer to a procedure
+// which is lowered later on.
+///////////////////////////////////////////////////////////////////////////////
+
+// libc functions used for operations TB has no instruction for
+typedef u32 C0TbExternKind;
+enum C0TbExternKind_enum {
+	C0TbExtern_memmove,
+	C0TbExtern_ceil,
+	C0TbExtern_ceilf,
+	C0TbExtern_floor,
+	C0TbExtern_floorf,
+	C0TbExtern_nearbyint,
+	C0TbExtern_nearbyintf,
+	C0TbExtern_trunc,
+	C0TbExtern_truncf,
+
+	C0TbExtern_COUNT
+};
+
+typedef u8 C0OptLevel;
+enum C0OptLevel_enum {
+	C0OptLevel_O0, // no TB passes and the fast instruction selector
+	C0OptLevel_O1, // locals promoted to registers and the dead code cleaned up
+	C0OptLevel_O2, // every TB pass and the complex instruction selector
+
+	C0OptLevel_COUNT
+};
+
+typedef struct C0TbTiming C0TbTiming;
+struct C0TbTiming {
+	char const *name;
+	f64         seconds;
+};
+
+typedef struct C0TbModule C0TbModule;
+struct C0TbModule {
+	TB_Module *mod;
+	C0Gen *    gen;
+
+	TB_Function **funcs; // indexed by `C0Proc.id`
+	usize         funcs_len;
+
+	TB_External *externs[C0TbExtern_COUNT]; // created on first use
+
+	// one entry per stage of `c0_tb_compile_procs`, in the order they ran
+	C0Array(C0TbTiming) timings;
+};
+
+// Declares a function for every procedure of `gen`
+void         c0_tb_module_init   (C0TbModule *m, TB_Module *mod, C0Gen *gen);
+void         c0_tb_module_destroy(C0TbModule *m);
+TB_Function *c0_tb_proc_function (C0TbModule *m, C0Proc *p);
+// Lowers the body of `p`, which must be finished, into its function
+TB_Function *c0_tb_emit_proc     (C0TbModule *m, C0Proc *p);
+
+// Lowers every finished procedure of `m->gen`, runs the TB passes of `opt_level` over
+// them and compiles them on `thread_count` threads (the calling thread being one
+// of them), returns false if TB fails on any
+bool c0_tb_compile_procs(C0TbModule *m, C0OptLevel opt_level, usize thread_count);
+void c0_tb_print_timings(C0Printer *p, C0TbModule *m);
+
+// Lowers and compiles every finished procedure of `gen` and writes them out as
+// an object file for the host (ELF on Linux, COFF on Windows)
+bool c0_gen_write_object(C0Gen *gen, char const *path, C0OptLevel opt_level, usize thread_count);
+
+
+typedef struct C0Jit C0Jit;
+struct C0Jit {
+	TB_Module *    mod;
+	TB_JITContext *ctx;
+	C0TbModule     tb;
+
+	void **procs; // indexed by `C0Proc.id`
+};
+
+// Lowers and compiles every finished procedure of `gen` into executable memory,
+// returns NULL if TB fails to compile one of them
+C0Jit *c0_jit_compile(C0Gen *gen, C0OptLevel opt_level, usize thread_count);
+void   c0_jit_destroy(C0Jit *jit);
+// The entry point of `p`, to be cast to a function pointer matching its signature
+void * c0_jit_proc   (C0Jit *jit, C0Proc *p);
+
 #ifdef C0_TB_IMPL
 
-void c0_tb_emit_proc(TB_Module *mod, C0Proc *p) {
-	assert(p->sig->kind == C0AggType_proc);
+#include <math.h>
+
+static char const *const c0_tb_extern_names[C0TbExtern_COUNT] = {
+	"memmove",
+	"ceil",
+	"ceilf",
+	"floor",
+	"floorf",
+	"nearbyint",
+	"nearbyintf",
+	"trunc",
+	"truncf",
+};
+
+// C0 integer arithmetic wraps around
+static TB_ArithmaticBehavior const c0_tb_wrap = (TB_ArithmaticBehavior)0;
+
+typedef struct C0TbLoop {
+	TB_Label head; // target of `continue`
+	TB_Label exit; // target of `break`
+} C0TbLoop;
+
+typedef struct C0TbProc {
+	C0TbModule * m;
+	C0Proc *     p;
+	TB_Function *f;
+
+	// the value of an instruction, the address of a variable or the block of a label
+	// neither a register nor a created block is ever 0
+	C0InstrMap regs;
+
+	C0Array(C0TbLoop) loops;
+	C0Array(TB_Reg)   call_args;
+	TB_Reg            fence_slot;
+} C0TbProc;
+
+static TB_DataType c0_tb_type(C0BasicType type) {
+	switch (type) {
+	case C0Basic_void: return TB_TYPE_VOID;
+	case C0Basic_i8:
+	case C0Basic_u8:   return TB_TYPE_I8;
+	case C0Basic_i16:
+	case C0Basic_u16:  return TB_TYPE_I16;
+	case C0Basic_i32:
+	case C0Basic_u32:  return TB_TYPE_I32;
+	case C0Basic_i64:
+	case C0Basic_u64:  return TB_TYPE_I64;
+	case C0Basic_f16:  return TB_TYPE_I16; // TB has no half floats, so only their bits are moved around
+	case C0Basic_f32:  return TB_TYPE_F32;
+	case C0Basic_f64:  return TB_TYPE_F64;
+	case C0Basic_ptr:  return TB_TYPE_PTR;
+	case C0Basic_i128:
+	case C0Basic_u128:
+		c0_errorf("TODO: support 128-bit integers in the TB backend");
+		break;
+	}
+	return TB_TYPE_VOID;
+}
+
+static TB_DataType c0_tb_agg_type(C0AggType *type) {
+	if (type->kind != C0AggType_basic) {
+		c0_errorf("TODO: aggregate parameters and results in the TB backend");
+		return TB_TYPE_VOID;
+	}
+	return c0_tb_type(type->basic.type);
+}
+
+static TB_DataType c0_tb_int_type(i64 size) {
+	switch (size) {
+	case 1: return TB_TYPE_I8;
+	case 2: return TB_TYPE_I16;
+	case 4: return TB_TYPE_I32;
+	}
+	return TB_TYPE_I64;
+}
+
+static bool c0_tb_is_float(C0BasicType type) {
+	return type == C0Basic_f32 || type == C0Basic_f64;
+}
+
+static void c0_tb_set(C0TbProc *t, C0Instr *instr, int reg) {
+	c0_instr_map_set(&t->regs, instr, (C0Instr *)(uintptr_t)reg);
+}
+static int c0_tb_get(C0TbProc *t, C0Instr *instr) {
+	return (int)(uintptr_t)c0_instr_map_get(&t->regs, instr);
+}
+
+static TB_CharUnits c0_tb_decl_align(C0TbProc *t, C0Instr *decl) {
+	if (decl->alignment) {
+		return decl->alignment;
+	}
+	if (decl->agg_type) {
+		return (TB_CharUnits)decl->agg_type->align;
+	}
+	return (TB_CharUnits)c0_basic_type_size(t->p->gen, decl->basic_type);
+}
+
+// The alignment known for an access of `type` through `ptr`
+static TB_CharUnits c0_tb_ptr_align(C0TbProc *t, C0Instr *ptr, C0BasicType type) {
+	if (ptr->kind == C0Instr_addr) {
+		return c0_tb_decl_align(t, ptr->args[0]);
+	}
+	return (TB_CharUnits)c0_basic_type_size(t->p->gen, type);
+}
+
+static TB_Reg c0_tb_constant(C0TbProc *t, C0Instr *decl) {
+	TB_DataType dt = c0_tb_type(decl->basic_type);
+	switch (decl->basic_type) {
+	case C0Basic_i8:
+	case C0Basic_i16:
+	case C0Basic_i32:
+	case C0Basic_i64:
+		return tb_inst_sint(t->f, dt, decl->value_i64);
+	case C0Basic_u8:
+	case C0Basic_u16:
+	case C0Basic_u32:
+	case C0Basic_u64:
+		return tb_inst_uint(t->f, dt, decl->value_u64);
+	case C0Basic_f16:
+		return tb_inst_uint(t->f, dt, decl->value_f16);
+	case C0Basic_f32:
+		return tb_inst_float32(t->f, decl->value_f32);
+	case C0Basic_f64:
+		return tb_inst_float64(t->f, decl->value_f64);
+	case C0Basic_ptr:
+		return tb_inst_ptr(t->f, decl->value_u64);
+	}
+	c0_errorf("invalid constant of type %s", c0_basic_names[decl->basic_type]);
+	return TB_NULL_REG;
+}
+
+static TB_Reg c0_tb_zero(C0TbProc *t, C0BasicType type) {
+	switch (type) {
+	case C0Basic_f32: return tb_inst_float32(t->f, 0);
+	case C0Basic_f64: return tb_inst_float64(t->f, 0);
+	case C0Basic_ptr: return tb_inst_ptr(t->f, 0);
+	}
+	return tb_inst_uint(t->f, c0_tb_type(type), 0);
+}
+
+// The current value of `instr`, a variable is read at the point of use
+static TB_Reg c0_tb_value(C0TbProc *t, C0Instr *instr) {
+	if (instr->kind == C0Instr_decl && (instr->flags & C0InstrFlag_constant) == 0) {
+		C0_ASSERT_MSG(instr->agg_type == NULL, "TODO: aggregate values in the TB backend");
+		return tb_inst_load(t->f, c0_tb_type(instr->basic_type), c0_tb_get(t, instr), c0_tb_decl_align(t, instr));
+	}
+	TB_Reg reg = c0_tb_get(t, instr);
+	C0_ASSERT_MSG(reg != TB_NULL_REG, "%s is used before it is defined", c0_instr_names[instr->kind]);
+	return reg;
+}
+
+static TB_Reg c0_tb_cond(C0TbProc *t, C0Instr *cond) {
+	return tb_inst_cmp_ne(t->f, c0_tb_value(t, cond), c0_tb_zero(t, cond->basic_type));
+}
+
+// C0 comparisons result in a u8
+static TB_Reg c0_tb_from_bool(C0TbProc *t, TB_Reg b) {
+	return tb_inst_zxt(t->f, b, TB_TYPE_I8);
+}
+
+// Extends or truncates an integer index or size to the size of a pointer
+static TB_Reg c0_tb_to_ptr_int(C0TbProc *t, C0Instr *instr) {
+	i64 ptr_size = t->p->gen->ptr_size;
+	i64 size = c0_basic_type_size(t->p->gen, instr->basic_type);
+	TB_Reg v = c0_tb_value(t, instr);
+	if (size < ptr_size) {
+		if (c0_basic_is_signed[instr->basic_type]) {
+			return tb_inst_sxt(t->f, v, c0_tb_int_type(ptr_size));
+		}
+		return tb_inst_zxt(t->f, v, c0_tb_int_type(ptr_size));
+	} else if (size > ptr_size) {
+		return tb_inst_trunc(t->f, v, c0_tb_int_type(ptr_size));
+	}
+	return v;
+}
+
+static TB_Label c0_tb_label(C0TbProc *t, C0Instr *label) {
+	TB_Label l = c0_tb_get(t, label);
+	if (l == 0) {
+		l = tb_basic_block_create(t->f);
+		c0_tb_set(t, label, l);
+	}
+	return l;
+}
+
+static bool c0_tb_block_complete(C0TbProc *t) {
+	return tb_basic_block_is_complete(t->f, tb_inst_get_label(t->f));
+}
+
+// Falls through into `l` unless the current block already ends
+static void c0_tb_jump(C0TbProc *t, TB_Label l) {
+	if (!c0_tb_block_complete(t)) {
+		tb_inst_goto(t->f, l);
+	}
+}
+
+static TB_Reg c0_tb_call_extern(C0TbProc *t, C0TbExternKind kind, TB_DataType dt, usize arg_count, TB_Reg const *args) {
+	C0TbModule *m = t->m;
+	if (m->externs[kind] == NULL) {
+		m->externs[kind] = tb_extern_create(m->mod, c0_tb_extern_names[kind], TB_EXTERNAL_SO_LOCAL);
+	}
+	return tb_inst_call(t->f, dt, (TB_Symbol *)m->externs[kind], arg_count, args);
+}
+
+static TB_Reg c0_tb_convert(C0TbProc *t, TB_Reg v, C0BasicType from, C0BasicType to) {
+	TB_DataType dt = c0_tb_type(to);
+	if (from == C0Basic_f16 || to == C0Basic_f16) {
+		c0_errorf("TODO: f16 conversions in the TB backend");
+		return v;
+	}
+	if (from == C0Basic_ptr) {
+		return to == C0Basic_ptr ? v : tb_inst_ptr2int(t->f, v, dt);
+	}
+	if (to == C0Basic_ptr) {
+		v = c0_tb_convert(t, v, from, t->p->gen->ptr_size == 4 ? C0Basic_u32 : C0Basic_u64);
+		return tb_inst_int2ptr(t->f, v);
+	}
+
+	bool from_float = c0_tb_is_float(from);
+	bool to_float   = c0_tb_is_float(to);
+	i32 from_size = c0_basic_type_sizes[from];
+	i32 to_size   = c0_basic_type_sizes[to];
+	if (from_float && to_float) {
+		return to_size > from_size ? tb_inst_fpxt(t->f, v, dt) : tb_inst_trunc(t->f, v, dt);
+	} else if (from_float) {
+		return tb_inst_float2int(t->f, v, dt, c0_basic_is_signed[to]);
+	} else if (to_float) {
+		return tb_inst_int2float(t->f, v, dt, c0_basic_is_signed[from]);
+	}
+
+	if (to_size > from_size) {
+		return c0_basic_is_signed[from] ? tb_inst_sxt(t->f, v, dt) : tb_inst_zxt(t->f, v, dt);
+	} else if (to_size < from_size) {
+		return tb_inst_trunc(t->f, v, dt);
+	}
+	return v;
+}
+
+static TB_Reg c0_tb_reinterpret(C0TbProc *t, TB_Reg v, C0BasicType from, C0BasicType to) {
+	TB_DataType dt = c0_tb_type(to);
+	if (from == C0Basic_ptr) {
+		return tb_inst_ptr2int(t->f, v, dt);
+	} else if (to == C0Basic_ptr) {
+		return tb_inst_int2ptr(t->f, v);
+	} else if (c0_tb_is_float(from) != c0_tb_is_float(to)) {
+		return tb_inst_bitcast(t->f, v, dt);
+	}
+	return v;
+}
+
+// Atomics operate on integers, floats are passed through as their bits
+static TB_Reg c0_tb_atomic_operand(C0TbProc *t, C0Instr *instr) {
+	TB_Reg v = c0_tb_value(t, instr);
+	if (c0_tb_is_float(instr->basic_type)) {
+		v = tb_inst_bitcast(t->f, v, c0_tb_int_type(c0_basic_type_sizes[instr->basic_type]));
+	}
+	return v;
+}
+static TB_Reg c0_tb_atomic_result(C0TbProc *t, TB_Reg v, C0BasicType type) {
+	if (c0_tb_is_float(type)) {
+		v = tb_inst_bitcast(t->f, v, c0_tb_type(type));
+	}
+	return v;
+}
+
+// TB has no fences, a sequentially consistent exchange on a stack slot is a full barrier
+static void c0_tb_fence(C0TbProc *t) {
+	if (t->fence_slot == TB_NULL_REG) {
+		t->fence_slot = tb_inst_local(t->f, 4, 4);
+	}
+	tb_inst_atomic_xchg(t->f, t->fence_slot, tb_inst_uint(t->f, TB_TYPE_I32, 0), TB_MEM_ORDER_SEQ_CST);
+}
+
+// Floating point read-modify-write through a compare and exchange loop, results in the old value
+static TB_Reg c0_tb_atomic_float_op(C0TbProc *t, C0InstrKind kind, C0Instr *dst, C0Instr *src) {
+	TB_Function *f = t->f;
+	C0BasicType type = src->basic_type;
+	TB_DataType dt  = c0_tb_type(type);
+	TB_DataType idt = c0_tb_int_type(c0_basic_type_sizes[type]);
+
+	TB_Reg addr  = c0_tb_value(t, dst);
+	TB_Reg value = c0_tb_value(t, src);
+
+	TB_Label retry = tb_basic_block_create(f);
+	TB_Label done  = tb_basic_block_create(f);
+	tb_inst_goto(f, retry);
+	tb_inst_set_label(f, retry);
+
+	TB_Reg old = tb_inst_atomic_load(f, addr, idt, TB_MEM_ORDER_SEQ_CST);
+	TB_Reg old_value = tb_inst_bitcast(f, old, dt);
+	TB_Reg new_value = TB_NULL_REG;
+	if (C0Instr_atomic_addf_f16 <= kind && kind <= C0Instr_atomic_addf_f64) {
+		new_value = tb_inst_fadd(f, old_value, value);
+	} else {
+		new_value = tb_inst_fsub(f, old_value, value);
+	}
+	TB_CmpXchgResult res = tb_inst_atomic_cmpxchg(f, addr, old, tb_inst_bitcast(f, new_value, idt), TB_MEM_ORDER_SEQ_CST, TB_MEM_ORDER_SEQ_CST);
+	tb_inst_if(f, res.success, done, retry);
+
+	tb_inst_set_label(f, done);
+	return old_value;
+}
+
+static TB_Reg c0_tb_popcnt(C0TbProc *t, TB_Reg x, TB_DataType dt, i32 bits) {
+	TB_Function *f = t->f;
+	u64 mask = bits == 64 ? ~0ull : (1ull<<bits)-1;
+	TB_Reg m1 = tb_inst_uint(f, dt, 0x5555555555555555ull & mask);
+	TB_Reg m2 = tb_inst_uint(f, dt, 0x3333333333333333ull & mask);
+	TB_Reg m4 = tb_inst_uint(f, dt, 0x0f0f0f0f0f0f0f0full & mask);
+	TB_Reg h  = tb_inst_uint(f, dt, 0x0101010101010101ull & mask);
+
+	x = tb_inst_sub(f, x, tb_inst_and(f, tb_inst_shr(f, x, tb_inst_uint(f, dt, 1)), m1), c0_tb_wrap);
+	x = tb_inst_add(f, tb_inst_and(f, x, m2), tb_inst_and(f, tb_inst_shr(f, x, tb_inst_uint(f, dt, 2)), m2), c0_tb_wrap);
+	x = tb_inst_and(f, tb_inst_add(f, x, tb_inst_shr(f, x, tb_inst_uint(f, dt, 4)), c0_tb_wrap), m4);
+	return tb_inst_shr(f, tb_inst_mul(f, x, h, c0_tb_wrap), tb_inst_uint(f, dt, bits-8));
+}
+
+// Lowers the instructions which are simple operations on values
+static TB_Reg c0_tb_emit_op(C0TbProc *t, C0Instr *instr) {
+	TB_Function *f = t->f;
+	C0InstrKind kind = instr->kind;
+	C0BasicType type = c0_instr_arg_type[kind];
+	bool is_signed   = c0_basic_is_signed[type];
+
+	if (C0Instr_load_u8 <= kind && kind <= C0Instr_load_ptr) {
+		TB_Reg addr = c0_tb_value(t, instr->args[0]);
+		return tb_inst_load(f, c0_tb_type(instr->basic_type), addr, c0_tb_ptr_align(t, instr->args[0], instr->basic_type));
+	} else if (C0Instr_store_u8 <= kind && kind <= C0Instr_store_ptr) {
+		C0Instr *src = instr->args[1];
+		TB_Reg addr = c0_tb_value(t, instr->args[0]);
+		tb_inst_store(f, c0_tb_type(src->basic_type), addr, c0_tb_value(t, src), c0_tb_ptr_align(t, instr->args[0], src->basic_type));
+		return TB_NULL_REG;
+	}
+
+	if (C0Instr_clz_u8 <= kind && kind <= C0Instr_abs_i128) {
+		TB_DataType dt = c0_tb_type(type);
+		i32 bits = 8*c0_basic_type_sizes[type];
+		TB_Reg a = c0_tb_value(t, instr->args[0]);
+		if (kind <= C0Instr_clz_u128) {
+			return tb_inst_clz(f, a);
+		} else if (kind <= C0Instr_ctz_u128) {
+			// the lowest set bit on its own has `bits-1-ctz` leading zeros
+			TB_Reg lowest = tb_inst_and(f, a, tb_inst_neg(f, a));
+			TB_Reg n = tb_inst_sub(f, tb_inst_uint(f, dt, bits-1), tb_inst_clz(f, lowest), c0_tb_wrap);
+			return tb_inst_select(f, tb_inst_cmp_eq(f, a, c0_tb_zero(t, type)), tb_inst_uint(f, dt, bits), n);
+		} else if (kind <= C0Instr_popcnt_u128) {
+			return c0_tb_popcnt(t, a, dt, bits);
+		}
+		TB_Reg is_negative = tb_inst_cmp_ilt(f, a, c0_tb_zero(t, type), true);
+		return tb_inst_select(f, is_negative, tb_inst_neg(f, a), a);
+	}
 
-	usize param_count = c0array_len(p->sig->proc.types);
-	for (usize i = 0; i < n; i++) {
-		C0AggType *pt = type->proc.types[i];
+	if (C0Instr_negf_f16 <= kind && kind <= C0Instr_sqrtf_f64) {
+		if (type == C0Basic_f16) {
+			c0_errorf("TODO: f16 arithmetic in the TB backend - %s", c0_instr_names[kind]);
+			return TB_NULL_REG;
+		}
+		bool is_f32 = type == C0Basic_f32;
+		TB_Reg a = c0_tb_value(t, instr->args[0]);
+		C0TbExternKind ext = C0TbExtern_COUNT;
+		switch (kind) {
+		case C0Instr_negf_f32:
+		case C0Instr_negf_f64:
+			return tb_inst_neg(f, a);
+		case C0Instr_absf_f32:
+		case C0Instr_absf_f64:
+			{
+				TB_DataType idt = c0_tb_int_type(c0_basic_type_sizes[type]);
+				u64 sign = 1ull << (8*c0_basic_type_sizes[type] - 1);
+				TB_Reg bits = tb_inst_and(f, tb_inst_bitcast(f, a, idt), tb_inst_uint(f, idt, ~sign));
+				return tb_inst_bitcast(f, bits, c0_tb_type(type));
+			}
+		case C0Instr_sqrtf_f32:
+		case C0Instr_sqrtf_f64:
+			return tb_inst_x86_sqrt(f, a);
+		case C0Instr_ceilf_f32:
+		case C0Instr_ceilf_f64:
+			ext = is_f32 ? C0TbExtern_ceilf : C0TbExtern_ceil;
+			break;
+		case C0Instr_floorf_f32:
+		case C0Instr_floorf_f64:
+			ext = is_f32 ? C0TbExtern_floorf : C0TbExtern_floor;
+			break;
+		case C0Instr_nearestf_f32:
+		case C0Instr_nearestf_f64:
+			ext = is_f32 ? C0TbExtern_nearbyintf : C0TbExtern_nearbyint;
+			break;
+		case C0Instr_truncf_f32:
+		case C0Instr_truncf_f64:
+			ext = is_f32 ? C0TbExtern_truncf : C0TbExtern_trunc;
+			break;
+		}
+		return c0_tb_call_extern(t, ext, c0_tb_type(type), 1, &a);
+	}
 
-		// lower parameter into TB stuff
-		switch (pt->kind) {
-			case C0AggType_basic:
-			if (type->basic.type == C0Basic_ptr) {
+	if (C0Instr_add_u8 <= kind && kind <= C0Instr_max_u128) {
+		TB_DataType dt = c0_tb_type(type);
+		i32 bits = 8*c0_basic_type_sizes[type];
+		TB_Reg a = c0_tb_value(t, instr->args[0]);
+		TB_Reg b = c0_tb_value(t, instr->args[1]);
+
+		if (kind <= C0Instr_add_u128) {
+			return tb_inst_add(f, a, b, c0_tb_wrap);
+		} else if (kind <= C0Instr_sub_u128) {
+			return tb_inst_sub(f, a, b, c0_tb_wrap);
+		} else if (kind <= C0Instr_mul_u128) {
+			return tb_inst_mul(f, a, b, c0_tb_wrap);
+		} else if (kind <= C0Instr_quo_u128) {
+			return tb_inst_div(f, a, b, is_signed);
+		} else if (kind <= C0Instr_rem_u128) {
+			return tb_inst_mod(f, a, b, is_signed);
+		} else if (kind <= C0Instr_shro_u128) {
+			// C-like shifts mask the amount, Odin-like shifts result in zero once it reaches the width
+			TB_Reg amount = tb_inst_and(f, b, tb_inst_uint(f, dt, bits-1));
+			TB_Reg res = TB_NULL_REG;
+			if (kind <= C0Instr_shlc_u128 || (C0Instr_shlo_i8 <= kind && kind <= C0Instr_shlo_u128)) {
+				res = tb_inst_shl(f, a, amount, c0_tb_wrap);
+			} else if (is_signed) {
+				res = tb_inst_sar(f, a, amount);
 			} else {
+				res = tb_inst_shr(f, a, amount);
+			}
+			if (kind >= C0Instr_shlo_i8) {
+				// compared with the signedness of the kind, like the printed helpers and the folder
+				TB_Reg in_range = tb_inst_cmp_ilt(f, b, tb_inst_uint(f, dt, bits), is_signed);
+				res = tb_inst_select(f, in_range, res, c0_tb_zero(t, type));
 			}
+			return res;
+		} else if (kind <= C0Instr_and_u128) {
+			return tb_inst_and(f, a, b);
+		} else if (kind <= C0Instr_or_u128) {
+			return tb_inst_or(f, a, b);
+		} else if (kind <= C0Instr_xor_u128) {
+			return tb_inst_xor(f, a, b);
+		} else if (kind <= C0Instr_eq_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_eq(f, a, b));
+		} else if (kind <= C0Instr_neq_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_ne(f, a, b));
+		} else if (kind <= C0Instr_lt_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_ilt(f, a, b, is_signed));
+		} else if (kind <= C0Instr_gt_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_igt(f, a, b, is_signed));
+		} else if (kind <= C0Instr_lteq_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_ile(f, a, b, is_signed));
+		} else if (kind <= C0Instr_gteq_u128) {
+			return c0_tb_from_bool(t, tb_inst_cmp_ige(f, a, b, is_signed));
+		} else if (kind <= C0Instr_min_u128) {
+			return tb_inst_select(f, tb_inst_cmp_ilt(f, a, b, is_signed), a, b);
+		}
+		return tb_inst_select(f, tb_inst_cmp_igt(f, a, b, is_signed), a, b);
+	}
+
+	if (C0Instr_addf_f16 <= kind && kind <= C0Instr_gteqf_f64) {
+		if (type == C0Basic_f16) {
+			c0_errorf("TODO: f16 arithmetic in the TB backend - %s", c0_instr_names[kind]);
+			return TB_NULL_REG;
+		}
+		TB_Reg a = c0_tb_value(t, instr->args[0]);
+		TB_Reg b = c0_tb_value(t, instr->args[1]);
+
+		if (kind <= C0Instr_addf_f64) {
+			return tb_inst_fadd(f, a, b);
+		} else if (kind <= C0Instr_subf_f64) {
+			return tb_inst_fsub(f, a, b);
+		} else if (kind <= C0Instr_mulf_f64) {
+			return tb_inst_fmul(f, a, b);
+		} else if (kind <= C0Instr_divf_f64) {
+			return tb_inst_fdiv(f, a, b);
+		} else if (kind <= C0Instr_eqf_f64) {
+			return c0_tb_from_bool(t, tb_inst_cmp_eq(f, a, b));
+		} else if (kind <= C0Instr_neqf_f64) {
+			return c0_tb_from_bool(t, tb_inst_cmp_ne(f, a, b));
+		} else if (kind <= C0Instr_ltf_f64) {
+			return c0_tb_from_bool(t, tb_inst_cmp_flt(f, a, b));
+		} else if (kind <= C0Instr_gtf_f64) {
+			return c0_tb_from_bool(t, tb_inst_cmp_fgt(f, a, b));
+		} else if (kind <= C0Instr_lteqf_f64) {
+			return c0_tb_from_bool(t, tb_inst_cmp_fle(f, a, b));
+		}
+		return c0_tb_from_bool(t, tb_inst_cmp_fge(f, a, b));
+	}
+
+	if (C0Instr_atomic_load_u8 <= kind && kind <= C0Instr_atomic_xor_u64) {
+		TB_MemoryOrder order = TB_MEM_ORDER_SEQ_CST;
+		TB_Reg addr = c0_tb_value(t, instr->args[0]);
+		if (kind <= C0Instr_atomic_load_ptr) {
+			C0BasicType res_type = instr->basic_type;
+			TB_DataType dt = res_type == C0Basic_ptr ? TB_TYPE_PTR : c0_tb_int_type(c0_basic_type_sizes[res_type]);
+			return c0_tb_atomic_result(t, tb_inst_atomic_load(f, addr, dt, order), res_type);
+		}
+
+		C0Instr *src = instr->args[1];
+		if (kind <= C0Instr_atomic_store_ptr) {
+			tb_inst_atomic_xchg(f, addr, c0_tb_atomic_operand(t, src), order);
+			return TB_NULL_REG;
+		} else if (kind <= C0Instr_atomic_xchg_f64) {
+			TB_Reg old = tb_inst_atomic_xchg(f, addr, c0_tb_atomic_operand(t, src), order);
+			return c0_tb_atomic_result(t, old, src->basic_type);
+		} else if (kind <= C0Instr_atomic_cas_f64) {
+			C0Instr *desired = instr->args[2];
+			TB_DataType idt = c0_tb_int_type(c0_basic_type_sizes[desired->basic_type]);
+			TB_Reg expected_ptr = c0_tb_value(t, src);
+			TB_CharUnits align = c0_tb_ptr_align(t, src, desired->basic_type);
+			TB_Reg expected = tb_inst_load(f, idt, expected_ptr, align);
+			TB_CmpXchgResult res = tb_inst_atomic_cmpxchg(f, addr, expected, c0_tb_atomic_operand(t, desired), order, order);
+			tb_inst_store(f, idt, expected_ptr, res.old_value, align);
+			return TB_NULL_REG;
+		}
+
+		switch (kind) {
+		case C0Instr_atomic_addf_f16:
+		case C0Instr_atomic_subf_f16:
+			c0_errorf("TODO: f16 arithmetic in the TB backend - %s", c0_instr_names[kind]);
+			return TB_NULL_REG;
+		case C0Instr_atomic_addf_f32:
+		case C0Instr_atomic_addf_f64:
+		case C0Instr_atomic_subf_f32:
+		case C0Instr_atomic_subf_f64:
+			return c0_tb_atomic_float_op(t, kind, instr->args[0], src);
+		}
+
+		TB_Reg value = c0_tb_value(t, src);
+		if (kind <= C0Instr_atomic_add_u64) {
+			return tb_inst_atomic_add(f, addr, value, order);
+		} else if (kind <= C0Instr_atomic_sub_u64) {
+			return tb_inst_atomic_sub(f, addr, value, order);
+		} else if (kind <= C0Instr_atomic_and_u64) {
+			return tb_inst_atomic_and(f, addr, value, order);
+		} else if (kind <= C0Instr_atomic_or_u64) {
+			return tb_inst_atomic_or(f, addr, value, order);
+		}
+		return tb_inst_atomic_xor(f, addr, value, order);
+	}
+
+	if (C0Instr_select_u8 <= kind && kind <= C0Instr_select_ptr) {
+		TB_Reg cond = c0_tb_cond(t, instr->args[0]);
+		return tb_inst_select(f, cond, c0_tb_value(t, instr->args[1]), c0_tb_value(t, instr->args[2]));
+	}
+
+	c0_errorf("unhandled instruction kind in the TB backend: %s", c0_instr_names[kind]);
+	return TB_NULL_REG;
+}
+
+static void c0_tb_emit_instr(C0TbProc *t, C0Instr *instr);
+
+static void c0_tb_emit_block(C0TbProc *t, C0Array(C0Instr *) instrs) {
+	for (isize i = 0; i < c0array_len(instrs); i++) {
+		c0_tb_emit_instr(t, instrs[i]);
+	}
+}
+
+static void c0_tb_emit_instr(C0TbProc *t, C0Instr *instr) {
+	TB_Function *f = t->f;
+	C0Gen *gen = t->p->gen;
+
+	if (instr->kind == C0Instr_label) {
+		TB_Label l = c0_tb_label(t, instr);
+		c0_tb_jump(t, l);
+		tb_inst_set_label(f, l);
+		return;
+	}
+	if (c0_tb_block_complete(t)) {
+		tb_inst_set_label(f, tb_basic_block_create(f));
+	}
+
+	switch (instr->kind) {
+	case C0Instr_invalid:
+		c0_errorf("unhandled instruction kind");
+		return;
+
+	case C0Instr_decl:
+		if (instr->flags & C0InstrFlag_constant) {
+			c0_tb_set(t, instr, c0_tb_constant(t, instr));
+		} else {
+			TB_CharUnits align = c0_tb_decl_align(t, instr);
+			TB_Reg addr = TB_NULL_REG;
+			if (instr->agg_type) {
+				addr = tb_inst_local(f, (u32)instr->agg_type->size, align);
+				tb_inst_memclr(f, addr, (TB_CharUnits)instr->agg_type->size, align);
+			} else {
+				addr = tb_inst_local(f, (u32)c0_basic_type_size(gen, instr->basic_type), align);
+				tb_inst_store(f, c0_tb_type(instr->basic_type), addr, c0_tb_constant(t, instr), align);
+			}
+			c0_tb_set(t, instr, addr);
+		}
+		return;
+
+	case C0Instr_addr:
+		c0_tb_set(t, instr, c0_tb_get(t, instr->args[0]));
+		return;
+
+	case C0Instr_index_ptr:
+		{
+			C0AggType *elem = instr->agg_type->array.elem;
+			TB_Reg base = c0_tb_value(t, instr->args[0]);
+			c0_tb_set(t, instr, tb_inst_array_access(f, base, c0_tb_to_ptr_int(t, instr->args[1]), (u32)elem->size));
+		}
+		return;
+	case C0Instr_field_ptr:
+		{
+			C0AggType *record = instr->agg_type;
+			usize index = (usize)instr->value_u64;
+			usize offset = 0;
+			for (usize i = 0; i < index; i++) {
+				offset = c0_align_formula(offset, (usize)record->record.aligns[i]);
+				offset += (usize)record->record.types[i]->size;
+			}
+			offset = c0_align_formula(offset, (usize)record->record.aligns[index]);
+			TB_Reg base = c0_tb_value(t, instr->args[0]);
+			c0_tb_set(t, instr, tb_inst_member_access(f, base, (i32)offset));
+		}
+		return;
+
+	case C0Instr_convert:
+		{
+			C0Instr *arg = instr->args[0];
+			c0_tb_set(t, instr, c0_tb_convert(t, c0_tb_value(t, arg), arg->basic_type, instr->basic_type));
+		}
+		return;
+	case C0Instr_reinterpret:
+		{
+			C0Instr *arg = instr->args[0];
+			c0_tb_set(t, instr, c0_tb_reinterpret(t, c0_tb_value(t, arg), arg->basic_type, instr->basic_type));
+		}
+		return;
+
+	case C0Instr_atomic_thread_fence:
+	case C0Instr_atomic_signal_fence:
+		c0_tb_fence(t);
+		return;
+
+	case C0Instr_memmove:
+		{
+			TB_Reg args[3] = {
+				c0_tb_value(t, instr->args[0]),
+				c0_tb_value(t, instr->args[1]),
+				c0_tb_to_ptr_int(t, instr->args[2]),
+			};
+			c0_tb_call_extern(t, C0TbExtern_memmove, TB_TYPE_PTR, 3, args);
+		}
+		return;
+	case C0Instr_memset:
+		{
+			TB_Reg dst = c0_tb_value(t, instr->args[0]);
+			TB_CharUnits align = c0_tb_ptr_align(t, instr->args[0], C0Basic_u8);
+			tb_inst_memset(f, dst, c0_tb_value(t, instr->args[1]), c0_tb_to_ptr_int(t, instr->args[2]), align);
+		}
+		return;
+
+	case C0Instr_call:
+		{
+			C0_ASSERT_MSG(instr->call_proc, "TODO: indirect calls in the TB backend");
+			TB_Function *callee = c0_tb_proc_function(t->m, instr->call_proc);
+			c0array_clear(t->call_args);
+			for (isize i = 0; i < instr->args_len; i++) {
+				c0array_push(t->call_args, c0_tb_value(t, instr->args[i]));
+			}
+			TB_DataType dt = c0_tb_agg_type(instr->call_sig->proc.ret);
+			TB_Reg res = tb_inst_call(f, dt, (TB_Symbol *)callee, (usize)instr->args_len, t->call_args);
+			if (!TB_IS_VOID_TYPE(dt)) {
+				c0_tb_set(t, instr, res);
+			}
+		}
+		return;
+
+	case C0Instr_if:
+		{
+			TB_Label then_label = tb_basic_block_create(f);
+			TB_Label end_label  = tb_basic_block_create(f);
+			TB_Label else_label = instr->args_len == 2 ? tb_basic_block_create(f) : end_label;
+			tb_inst_if(f, c0_tb_cond(t, instr->args[0]), then_label, else_label);
+
+			tb_inst_set_label(f, then_label);
+			c0_tb_emit_block(t, instr->nested_instrs);
+			c0_tb_jump(t, end_label);
+
+			if (instr->args_len == 2) {
+				tb_inst_set_label(f, else_label);
+				c0_tb_emit_instr(t, instr->args[1]);
+				c0_tb_jump(t, end_label);
+			}
+			tb_inst_set_label(f, end_label);
+		}
+		return;
+
+	case C0Instr_loop:
+		{
+			C0TbLoop loop = {0};
+			loop.head = tb_basic_block_create(f);
+			loop.exit = tb_basic_block_create(f);
+			tb_inst_goto(f, loop.head);
+			tb_inst_set_label(f, loop.head);
+
+			c0array_push(t->loops, loop);
+			c0_tb_emit_block(t, instr->nested_instrs);
+			c0array_pop(t->loops);
+
+			c0_tb_jump(t, loop.head);
+			tb_inst_set_label(f, loop.exit);
+		}
+		return;
+
+	case C0Instr_block:
+		c0_tb_emit_block(t, instr->nested_instrs);
+		return;
+
+	case C0Instr_continue:
+		C0_ASSERT(c0array_len(t->loops) > 0);
+		tb_inst_goto(f, c0array_last(t->loops).head);
+		return;
+	case C0Instr_break:
+		C0_ASSERT(c0array_len(t->loops) > 0);
+		tb_inst_goto(f, c0array_last(t->loops).exit);
+		return;
+	case C0Instr_return:
+		tb_inst_ret(f, instr->args_len != 0 ? c0_tb_value(t, instr->args[0]) : TB_NULL_REG);
+		return;
+	case C0Instr_unreachable:
+		tb_inst_unreachable(f);
+		return;
+	case C0Instr_goto:
+		tb_inst_goto(f, c0_tb_label(t, instr->args[0]));
+		return;
+	}
+
+	TB_Reg res = c0_tb_emit_op(t, instr);
+	if (res != TB_NULL_REG) {
+		c0_tb_set(t, instr, res);
+	}
+}
+
+void c0_tb_module_init(C0TbModule *m, TB_Module *mod, C0Gen *gen) {
+	memset(m, 0, sizeof(*m));
+	m->mod = mod;
+	m->gen = gen;
+	m->funcs_len = (usize)gen->next_proc_id + 1;
+	m->funcs = (TB_Function **)c0_heap_calloc(sizeof(TB_Function *), m->funcs_len);
+
+	for (isize i = 0; i < c0array_len(gen->procs); i++) {
+		C0Proc *p = gen->procs[i];
+		C0AggType *sig = p->sig;
+
+		TB_CallingConv conv = sig->proc.call_conv == C0ProcCallConv_stdcall ? TB_STDCALL : TB_CDECL;
+		isize param_count = c0array_len(sig->proc.types);
+		bool is_variadic = (sig->proc.flags & C0ProcFlag_variadic) != 0;
+		TB_FunctionPrototype *proto = tb_prototype_create(mod, conv, c0_tb_agg_type(sig->proc.ret), NULL, (int)param_count, is_variadic);
+		for (isize j = 0; j < param_count; j++) {
+			tb_prototype_add_param(proto, c0_tb_agg_type(sig->proc.types[j]));
+		}
+
+		char const *name = p->name.text; // interned, so it is NUL terminated
+		if (p->name.len == 0) {
+			char buf[32] = {0};
+			snprintf(buf, sizeof(buf), "_C0_proc_%u", p->id);
+			name = c0_arena_cstr_dup(&gen->arena, buf);
+		}
+		TB_Linkage linkage = p->linkage == C0ProcLinkage_private ? TB_LINKAGE_PRIVATE : TB_LINKAGE_PUBLIC;
+		TB_Function *func = tb_function_create(mod, name, linkage);
+		tb_function_set_prototype(func, proto);
+		m->funcs[p->id] = func;
+	}
+}
+
+void c0_tb_module_destroy(C0TbModule *m) {
+	c0array_free(m->timings);
+	c0_heap_free(m->funcs);
+	m->funcs = NULL;
+	m->funcs_len = 0;
+}
+
+TB_Function *c0_tb_proc_function(C0TbModule *m, C0Proc *p) {
+	C0_ASSERT_MSG(p->id < m->funcs_len && m->funcs[p->id], "procedure was created after c0_tb_module_init");
+	return m->funcs[p->id];
+}
+
+TB_Function *c0_tb_emit_proc(C0TbModule *m, C0Proc *p) {
+	C0_ASSERT(p->finished);
+	C0_ASSERT(p->sig->kind == C0AggType_proc);
+
+	C0TbProc t = {0};
+	t.m = m;
+	t.p = p;
+	t.f = c0_tb_proc_function(m, p);
+
+	isize param_index = 0;
+	for (isize i = 0; i < c0array_len(p->sig->proc.names); i++) {
+		if (p->sig->proc.names[i].len > 0) {
+			c0_tb_set(&t, p->parameters[param_index++], tb_inst_param_addr(t.f, (int)i));
+		}
+	}
+
+	c0_tb_emit_block(&t, p->instrs);
+	if (!c0_tb_block_complete(&t)) {
+		if (c0_types_agg_basic(p->sig->proc.ret, C0Basic_void)) {
+			tb_inst_ret(t.f, TB_NULL_REG);
+		} else {
+			tb_inst_unreachable(t.f);
+		}
+	}
+
+	c0array_free(t.call_args);
+	c0array_free(t.loops);
+	c0_instr_map_destroy(&t.regs);
+	return t.f;
+}
+
+typedef struct C0TbWorker C0TbWorker;
+struct C0TbWorker {
+	C0Thread thread;
+
+	C0TbModule *     m;
+	C0Proc **        order;
+	usize            order_len;
+	usize            index;
+	TB_ISelMode      isel_mode;
+	C0Atomic(usize) *next_proc;
+	bool             ok;
+};
+
+static void c0_tb_worker_proc(void *data) {
+	C0TbWorker *w = (C0TbWorker *)data;
+	for (;;) {
+		usize i = c0_atomic_fetch_add(w->next_proc, 1);
+		if (i >= w->order_len) {
 			break;
 		}
+		TB_Function *f = c0_tb_proc_function(w->m, w->order[i]);
+		if (!tb_module_compile_function(w->m->mod, f, w->isel_mode)) {
+			w->ok = false;
+		}
+	}
+	if (w->index != 0) {
+		tb_free_thread_resources();
+	}
+}
+
+typedef TB_Pass (*C0TbPassProc)(void);
+
+static C0TbPassProc const c0_tb_o1_passes[] = {
+	tb_opt_hoist_locals,
+	tb_opt_mem2reg,
+	tb_opt_remove_pass_nodes,
+	tb_opt_dead_expr_elim,
+	tb_opt_dead_block_elim,
+	tb_opt_compact_dead_regs,
+};
+
+static C0TbPassProc const c0_tb_o2_passes[] = {
+	tb_opt_hoist_locals,
+	tb_opt_merge_rets,
+	tb_opt_mem2reg,
+	tb_opt_instcombine,
+	tb_opt_remove_pass_nodes,
+	tb_opt_subexpr_elim,
+	tb_opt_load_store_elim,
+	tb_opt_instcombine,
+	tb_opt_remove_pass_nodes,
+	tb_opt_dead_expr_elim,
+	tb_opt_dead_block_elim,
+	tb_opt_compact_dead_regs,
+};
+
+static void c0_tb_add_timing(C0TbModule *m, char const *name, f64 start) {
+	C0TbTiming t = {name, c0_time_now() - start};
+	c0array_push(m->timings, t);
+}
+
+static int c0_tb_proc_size_cmp(void const *a, void const *b) {
+	C0Proc *x = *(C0Proc *const *)a;
+	C0Proc *y = *(C0Proc *const *)b;
+	if (x->instr_count != y->instr_count) {
+		return x->instr_count > y->instr_count ? -1 : +1;
+	}
+	return x->id < y->id ? -1 : x->id > y->id;
+}
+
+bool c0_tb_compile_procs(C0TbModule *m, C0OptLevel opt_level, usize thread_count) {
+	C0_ASSERT(opt_level < C0OptLevel_COUNT);
+	C0Gen *gen = m->gen;
+	c0array_clear(m->timings);
+	f64 start = c0_time_now();
+
+	C0Array(C0Proc *) order = NULL;
+	for (isize i = 0; i < c0array_len(gen->procs); i++) {
+		C0Proc *p = gen->procs[i];
+		if (p->finished) {
+			c0_tb_emit_proc(m, p);
+			c0array_push(order, p);
+		}
+	}
+	c0_tb_add_timing(m, "lower", start);
+
+	C0TbPassProc const *passes = NULL;
+	usize pass_count = 0;
+	if (opt_level == C0OptLevel_O1) {
+		passes = c0_tb_o1_passes;
+		pass_count = sizeof(c0_tb_o1_passes)/sizeof(c0_tb_o1_passes[0]);
+	} else if (opt_level == C0OptLevel_O2) {
+		passes = c0_tb_o2_passes;
+		pass_count = sizeof(c0_tb_o2_passes)/sizeof(c0_tb_o2_passes[0]);
+	}
+	for (usize i = 0; i < pass_count; i++) {
+		TB_Pass pass = passes[i]();
+		start = c0_time_now();
+		tb_module_optimize(m->mod, 1, &pass);
+		c0_tb_add_timing(m, pass.name, start);
+	}
+
+	TB_ISelMode isel_mode = opt_level == C0OptLevel_O2 ? TB_ISEL_COMPLEX : TB_ISEL_FAST;
+	start = c0_time_now();
+
+	usize n = (usize)c0array_len(order);
+	if (thread_count > n) {
+		thread_count = n;
+	}
+	if (thread_count == 0) {
+		thread_count = 1;
+	}
+
+	// the largest procedures go first so a big one is not left for the end on a single thread
+	if (n > 1) {
+		qsort(order, n, sizeof(C0Proc *), c0_tb_proc_size_cmp);
 	}
 
-	TB_FunctionPrototype* proto = tb_prototype_create(mod, TB_CDECL, TB_TYPE_VOID, NULL, 1, false);
-	tb_prototype_add_param(proto, TB_TYPE_PTR);
+	C0Atomic(usize) next_proc;
+	c0_atomic_store(&next_proc, 0);
 
-	TB_Function* func = tb_function_create(mod, "entry", TB_LINKAGE_PUBLIC);
-	tb_function_set_prototype(func, proto);
-	tb_inst_ret(func, TB_NULL_REG);
+	C0TbWorker *workers = (C0TbWorker *)c0_heap_calloc(sizeof(C0TbWorker), thread_count);
+	for (usize i = 0; i < thread_count; i++) {
+		C0TbWorker *w = &workers[i];
+		w->m         = m;
+		w->order     = order;
+		w->order_len = n;
+		w->index     = i;
+		w->isel_mode = isel_mode;
+		w->next_proc = &next_proc;
+		w->ok        = true;
+	}
+
+	for (usize i = 1; i < thread_count; i++) {
+		c0_thread_start(&workers[i].thread, c0_tb_worker_proc, &workers[i]);
+	}
+	c0_tb_worker_proc(&workers[0]);
+	bool ok = workers[0].ok;
+	for (usize i = 1; i < thread_count; i++) {
+		c0_thread_join(&workers[i].thread);
+		ok = ok && workers[i].ok;
+	}
+
+	c0_tb_add_timing(m, "isel", start);
+
+	c0_heap_free(workers);
+	c0array_free(order);
+	return ok;
+}
+
+void c0_tb_print_timings(C0Printer *p, C0TbModule *m) {
+	f64 total = 0;
+	for (isize i = 0; i < c0array_len(m->timings); i++) {
+		C0TbTiming *t = &m->timings[i];
+		c0_printf(p, "%-20s %10.3f ms\n", t->name, t->seconds*1000.0);
+		total += t->seconds;
+	}
+	c0_printf(p, "%-20s %10.3f ms\n", "total", total*1000.0);
+}
+
+bool c0_gen_write_object(C0Gen *gen, char const *path, C0OptLevel opt_level, usize thread_count) {
+	TB_FeatureSet features = {0};
+	TB_Module *mod = tb_module_create_for_host(&features, false);
+	C0TbModule tb = {0};
+	c0_tb_module_init(&tb, mod, gen);
+
+	bool ok = c0_tb_compile_procs(&tb, opt_level, thread_count);
+	if (ok) {
+		ok = tb_exporter_write_files(mod, TB_FLAVOR_OBJECT, TB_DEBUGFMT_NONE, 1, &path);
+	}
+
+	c0_tb_module_destroy(&tb);
+	tb_module_destroy(mod);
+	return ok;
+}
+
+static void *c0_jit_extern_ptr(C0TbExternKind kind) {
+	switch (kind) {
+	case C0TbExtern_memmove:    return (void *)&memmove;
+	case C0TbExtern_ceil:       return (void *)(double (*)(double))&ceil;
+	case C0TbExtern_ceilf:      return (void *)(float (*)(float))&ceilf;
+	case C0TbExtern_floor:      return (void *)(double (*)(double))&floor;
+	case C0TbExtern_floorf:     return (void *)(float (*)(float))&floorf;
+	case C0TbExtern_nearbyint:  return (void *)(double (*)(double))&nearbyint;
+	case C0TbExtern_nearbyintf: return (void *)(float (*)(float))&nearbyintf;
+	case C0TbExtern_trunc:      return (void *)(double (*)(double))&trunc;
+	case C0TbExtern_truncf:     return (void *)(float (*)(float))&truncf;
+	}
+	C0_PANIC("invalid extern kind");
+	return NULL;
+}
+
+C0Jit *c0_jit_compile(C0Gen *gen, C0OptLevel opt_level, usize thread_count) {
+	TB_FeatureSet features = {0};
+	C0Jit *jit = (C0Jit *)c0_heap_calloc(sizeof(C0Jit), 1);
+	jit->mod = tb_module_create_for_host(&features, true);
+	c0_tb_module_init(&jit->tb, jit->mod, gen);
+
+	if (!c0_tb_compile_procs(&jit->tb, opt_level, thread_count)) {
+		c0_jit_destroy(jit);
+		return NULL;
+	}
+
+	// the externs must point somewhere before the code is placed in the JIT heap
+	for (C0TbExternKind kind = 0; kind < C0TbExtern_COUNT; kind++) {
+		if (jit->tb.externs[kind]) {
+			tb_symbol_bind_ptr((TB_Symbol *)jit->tb.externs[kind], c0_jit_extern_ptr(kind));
+		}
+	}
+
+	jit->ctx = tb_module_begin_jit(jit->mod, 0);
+	jit->procs = (void **)c0_heap_calloc(sizeof(void *), jit->tb.funcs_len);
+	for (isize i = 0; i < c0array_len(gen->procs); i++) {
+		C0Proc *p = gen->procs[i];
+		if (p->finished) {
+			jit->procs[p->id] = tb_function_get_jit_pos(c0_tb_proc_function(&jit->tb, p));
+		}
+	}
+	return jit;
+}
+
+void c0_jit_destroy(C0Jit *jit) {
+	if (jit == NULL) {
+		return;
+	}
+	if (jit->ctx) {
+		tb_module_end_jit(jit->ctx);
+	}
+	c0_tb_module_destroy(&jit->tb);
+	tb_module_destroy(jit->mod);
+	c0_heap_free(jit->procs);
+	c0_heap_free(jit);
+}
 
-	tb_function_print(func, tb_default_print_callback, stdout, false);
-	// tb_module_compile_function(mod, func, TB_ISEL_FAST);
+void *c0_jit_proc(C0Jit *jit, C0Proc *p) {
+	C0_ASSERT_MSG(p->id < jit->tb.funcs_len && jit->procs[p->id], "procedure was not compiled by c0_jit_compile");
+	return jit->procs[p->id];
 }
 
 #endif /* C0_TB_IMPL */
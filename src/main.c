@@ -62,12 +62,208 @@ C0Proc *test_fibonacci(C0Gen *gen) {
 	return c0_proc_finish(p);
 }
 
+// Folding must give the same results as the printed C would
+void test_fold_convert(void) {
+	C0Gen gen = {0};
+	c0_gen_init(&gen);
+
+	C0AggType *agg_void = c0_agg_type_basic(&gen, C0Basic_void);
+	C0Proc *p = c0_proc_create(&gen, C0STR("fold_convert"), c0_agg_type_proc(&gen, agg_void, NULL, NULL, 0));
+
+	C0Instr *i8_to_i32  = c0_push_convert(p, C0Basic_i32, c0_push_basic_i8(p, -1));
+	C0Instr *i8_to_u32  = c0_push_convert(p, C0Basic_u32, c0_push_basic_i8(p, -1));
+	C0Instr *i32_to_i64 = c0_push_convert(p, C0Basic_i64, c0_push_basic_i32(p, -5));
+	C0Instr *u8_to_u32  = c0_push_convert(p, C0Basic_u32, c0_push_basic_u8(p, 255));
+	c0_proc_finish(p);
+
+	C0_ASSERT(i8_to_i32->kind == C0Instr_decl && i8_to_i32->value_i64 == -1);
+	C0_ASSERT(i8_to_u32->kind == C0Instr_decl && i8_to_u32->value_u64 == 0xffffffffu);
+	C0_ASSERT(i32_to_i64->kind == C0Instr_decl && i32_to_i64->value_i64 == -5);
+	C0_ASSERT(u8_to_u32->kind == C0Instr_decl && u8_to_u32->value_u64 == 255);
+
+	c0_gen_destroy(&gen);
+}
+
+static C0Instr *test_push_call(C0Proc *p, C0Proc *call_proc, isize args_len, C0Instr **args) {
+	C0Instr *call = c0_instr_create(p, C0Instr_call);
+	call->call_sig = call_proc->sig;
+	call->basic_type = call_proc->sig->proc.ret->basic.type;
+	call->call_proc = call_proc;
+	c0_alloc_args(p, call, args_len);
+	for (isize i = 0; i < args_len; i++) {
+		call->args[i] = c0_use(args[i]);
+	}
+	return c0_instr_push(p, call);
+}
+
+// a loop, a label with a backward goto, an if with an else and a call with spilled arguments
+C0Proc *test_compact_shapes(C0Gen *gen) {
+	C0AggType *agg_u32 = c0_agg_type_basic(gen, C0Basic_u32);
+
+	C0Array(C0AggType *) sum_types = NULL;
+	C0Array(C0String) sum_names = NULL;
+	for (isize i = 0; i < 5; i++) {
+		static char const *const names[5] = {"a", "b", "c", "d", "e"};
+		C0String name = {names[i], 1};
+		c0array_push(sum_types, agg_u32);
+		c0array_push(sum_names, name);
+	}
+	C0Proc *sum = c0_proc_create(gen, C0STR("sum5"), c0_agg_type_proc(gen, agg_u32, sum_names, sum_types, C0ProcFlag_never_inline));
+	C0Instr *total = sum->parameters[0];
+	for (isize i = 1; i < 5; i++) {
+		total = c0_push_add(sum, total, sum->parameters[i]);
+	}
+	c0_push_return(sum, total);
+	c0_proc_finish(sum);
+
+	C0Array(C0AggType *) sig_types = NULL;
+	c0array_push(sig_types, agg_u32);
+	C0Array(C0String) sig_names = NULL;
+	c0array_push(sig_names, C0STR("n"));
+	C0Proc *p = c0_proc_create(gen, C0STR("compact_shapes"), c0_agg_type_proc(gen, agg_u32, sig_names, sig_types, 0));
+	C0Instr *n = p->parameters[0];
+
+	C0Instr *i = c0_push_decl_basic(p, C0Basic_u32, C0STR("i"));
+	C0Instr *again = c0_push_label(p, C0STR("again"));
+	c0_push_loop(p);
+	{
+		c0_push_if(p, c0_push_gteq(p, i, n));
+		{
+			c0_push_break(p);
+		}
+		c0_pop_if(p);
+		c0_push_store_basic(p, i, c0_push_add(p, i, c0_push_basic_u32(p, 1)));
+	}
+	c0_pop_loop(p);
+
+	C0Instr *res = c0_push_decl_basic(p, C0Basic_u32, C0STR("res"));
+	C0Instr *if_stmt = c0_push_if(p, c0_push_lt(p, i, c0_push_basic_u32(p, 3)));
+	{
+		c0_push_goto(p, again);
+	}
+	c0_pop_if(p);
+	C0Instr *else_stmt = c0_block_create(p);
+	c0_push_else_to_if(p, if_stmt, else_stmt);
+	c0_block_start(p, else_stmt);
+	{
+		C0Instr *args[5] = {i, n, c0_push_basic_u32(p, 3), i, n};
+		c0_push_store_basic(p, res, test_push_call(p, sum, 5, args));
+	}
+	c0_pop_block(p);
+	c0_push_return(p, res);
+
+	return c0_proc_finish(p);
+}
+
+// Converting a procedure to its compact form and back must print the same C
+void test_compact_round_trip(void) {
+	C0Gen gen = {0};
+	c0_gen_init(&gen);
+	gen.tail_calls = true;
+
+	test_factorial(&gen);
+	test_fibonacci(&gen);
+	test_compact_shapes(&gen);
+
+	for (isize i = 0; i < c0array_len(gen.procs); i++) {
+		C0Proc *p = gen.procs[i];
+
+		C0Printer before = {0};
+		before.flags |= C0PrinterFlag_UseInlineArgs;
+		c0_printer_init_buffer(&before);
+		c0_print_proc(&before, p);
+
+		C0CompactProc c = {0};
+		c0_compact_from_proc(&c, p);
+		c0_compact_to_proc(&c, p);
+		c0_compact_destroy(&c);
+
+		C0Printer after = {0};
+		after.flags |= C0PrinterFlag_UseInlineArgs;
+		c0_printer_init_buffer(&after);
+		c0_print_proc(&after, p);
+
+		C0String a = c0_printer_contents(&before);
+		C0String b = c0_printer_contents(&after);
+		C0_ASSERT(a.len == b.len && memcmp(a.text, b.text, a.len) == 0);
+
+		c0_printer_destroy(&after);
+		c0_printer_destroy(&before);
+	}
+
+	c0_gen_destroy(&gen);
+}
+
+enum {
+	TEST_ARENA_THREADS = 8,
+	TEST_ARENA_ALLOCS  = 20000,
+};
+
+typedef struct TestArenaWorker TestArenaWorker;
+struct TestArenaWorker {
+	C0Thread thread;
+	C0Arena *arena;
+	u8       id;
+	u8 *     ptrs[TEST_ARENA_ALLOCS];
+};
+
+// mostly small allocations, with the odd one too large for the per-thread chunks
+static usize test_arena_alloc_size(usize i) {
+	return i % 97 == 0 ? 4096 : 1 + i % 200;
+}
+
+static void test_arena_worker_proc(void *data) {
+	TestArenaWorker *w = (TestArenaWorker *)data;
+	for (usize i = 0; i < TEST_ARENA_ALLOCS; i++) {
+		usize size = test_arena_alloc_size(i);
+		u8 *ptr = (u8 *)c0_arena_alloc(w->arena, size, 16);
+		C0_ASSERT(((uintptr_t)ptr & 15) == 0);
+		memset(ptr, w->id, size);
+		w->ptrs[i] = ptr;
+	}
+}
+
+// Threads sharing a thread-safe arena must never be handed overlapping memory
+void test_arena_threads(bool reserve) {
+	C0Arena arena = {0};
+	arena.flags = C0ArenaFlag_thread_safe;
+	if (reserve) {
+		c0_arena_init_reserve(&arena, 0);
+	}
+
+	TestArenaWorker *workers = (TestArenaWorker *)c0_heap_calloc(sizeof(TestArenaWorker), TEST_ARENA_THREADS);
+	for (usize i = 0; i < TEST_ARENA_THREADS; i++) {
+		workers[i].arena = &arena;
+		workers[i].id    = (u8)(i+1);
+		c0_thread_start(&workers[i].thread, test_arena_worker_proc, &workers[i]);
+	}
+	for (usize i = 0; i < TEST_ARENA_THREADS; i++) {
+		c0_thread_join(&workers[i].thread);
+	}
+
+	for (usize i = 0; i < TEST_ARENA_THREADS; i++) {
+		TestArenaWorker *w = &workers[i];
+		for (usize j = 0; j < TEST_ARENA_ALLOCS; j++) {
+			usize size = test_arena_alloc_size(j);
+			for (usize k = 0; k < size; k++) {
+				C0_ASSERT(w->ptrs[j][k] == w->id);
+			}
+		}
+	}
+
+	c0_heap_free(workers);
+	c0_arena_destroy(&arena);
+}
 
 int main(int argc, char const **argv) {
-	setvbuf(stdout, NULL, _IONBF, 0);
 	setvbuf(stderr, NULL, _IONBF, 0);
 
 	c0_platform_virtual_memory_init();
+	test_fold_convert();
+	test_compact_round_trip();
+	test_arena_threads(false);
+	test_arena_threads(true);
+
 	C0Gen gen = {0};
 	c0_gen_init(&gen);
 
@@ -76,15 +272,34 @@ int main(int argc, char const **argv) {
 
 	C0Printer printer = {0};
 	printer.flags |= C0PrinterFlag_UseInlineArgs;
+	c0_printer_init_fd(&printer, 1 /*stdout*/);
 
 	c0_gen_instructions_print(&printer, &gen);
 	c0_print_proc(&printer, factorial);
 	c0_print_proc(&printer, fibonacci);
+	// the printer writes to the fd directly, everything after this goes through stdio
+	c0_printer_flush(&printer);
 
-	// TB_FeatureSet features = { 0 };
-	// TB_Module* mod = tb_module_create_for_host(&features, true);
+	TB_FeatureSet features = {0};
+	TB_Module *mod = tb_module_create_for_host(&features, false);
+	C0TbModule tb = {0};
+	c0_tb_module_init(&tb, mod, &gen);
+	tb_function_print(c0_tb_emit_proc(&tb, factorial), tb_default_print_callback, stdout, false);
+	tb_function_print(c0_tb_emit_proc(&tb, fibonacci), tb_default_print_callback, stdout, false);
+	c0_tb_module_destroy(&tb);
+	tb_module_destroy(mod);
+
+	C0Jit *jit = c0_jit_compile(&gen, C0OptLevel_O1, 1);
+	if (jit) {
+		typedef u32 (*C0U32Proc)(u32 n);
+		C0U32Proc jit_factorial = (C0U32Proc)c0_jit_proc(jit, factorial);
+		C0U32Proc jit_fibonacci = (C0U32Proc)c0_jit_proc(jit, fibonacci);
+		printf("factorial(10) = %u\n", jit_factorial(10));
+		printf("fibonacci(20) = %u\n", jit_fibonacci(20));
+		c0_jit_destroy(jit);
+	}
 
-	arena_free_all(&printer.arena);
+	c0_printer_destroy(&printer);
 
 	fflush(stderr);
 	fflush(stdout);